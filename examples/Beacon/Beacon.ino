@@ -0,0 +1,78 @@
+/* Beacon
+
+	NOTES: Presence beacon using TX payload reuse.
+		   The payload is uploaded once with beaconLoad and every beaconSend
+		   retransmits it with a CE pulse alone. The payload only goes over SPI
+		   again when its content changes.
+
+		   Set reuseMode to 0 to compare against the current approach, txData
+		   every cycle. The time spent per beacon is printed in us.
+
+		   SPI bytes per beacon:
+		     txData + clear_interrupts  1 + payload + 7
+		     beaconSend                 0
+		     beaconLoad (new content)   payload + 5
+*/
+
+#include <nRF24L01_define_map.h>
+#include <nRF24L01p.h>
+#include <SPI.h>
+
+// GLOBALS >> GLOBALS  >> GLOBALS  >> GLOBALS  >> GLOBALS
+int reuseMode = 1; // reuseMode = 1 for beaconSend, 0 for txData every cycle
+
+int CE_pin = 9;
+int CSN_pin = 10;
+NRF24L01p myRadio(CE_pin,CSN_pin);
+
+const int beaconWidth = 3; // number of bytes in the beacon
+unsigned char beaconAddr [] = {0xC3,0xC3,0xC3};
+unsigned char beaconData [] = {0x10, 0x00, 0x00}; // node id, battery level, flags
+
+unsigned long beaconCount = 0;
+// GLOBALS << GLOBALS  << GLOBALS  << GLOBALS  << GLOBALS
+
+void setup()
+{
+	Serial.begin(9600);
+	SPI.begin();
+	myRadio.begin();
+
+	unsigned char pipesOn [] = {0x01};
+	myRadio.setup_data_pipes(pipesOn, beaconWidth);
+	myRadio.clear_interrupts();
+	myRadio.beaconBegin(beaconAddr, 3);
+	// txData needs the beacon address on pipe 0 for its ACK
+	myRadio.writeRegister(RX_ADDR_P0, beaconAddr, 3);
+
+	delay(100);
+}
+
+
+void loop()
+{
+	// Content changes rarely, beaconLoad only uploads it when it does
+	beaconData[1] = (unsigned char)(beaconCount / 100);
+
+	unsigned long startTime = micros();
+	if (reuseMode)
+	{
+		myRadio.beaconLoad(beaconData, beaconWidth);
+		myRadio.beaconSend();
+	}
+	else
+	{
+		myRadio.txData(beaconData, beaconWidth);
+		myRadio.clear_interrupts();
+	}
+	unsigned long beaconTime = micros() - startTime;
+
+	beaconCount++;
+	if (beaconCount % 100 == 0)
+	{
+		Serial.print("us per beacon: ");
+		Serial.println(beaconTime);
+	}
+
+	delay(10);
+}
@@ -0,0 +1,79 @@
+/* FastRestore
+
+	NOTES: Recovers the radio configuration from a snapshot instead of running
+		   the full setup sequence again.
+
+		   The first boot runs the normal setup and saves a snapshot to EEPROM.
+		   Later boots restore from EEPROM. The loop checks CONFIG every 100ms
+		   and restores the snapshot if the radio has silently reset (brownout).
+		   Every restore prints how long it took in us.
+*/
+
+#include <nRF24L01_define_map.h>
+#include <nRF24L01p.h>
+#include <SPI.h>
+#include <EEPROM.h>
+
+// GLOBALS >> GLOBALS  >> GLOBALS  >> GLOBALS  >> GLOBALS
+int CE_pin = 9;
+int CSN_pin = 10;
+NRF24L01p myRadio(CE_pin,CSN_pin);
+
+const int fixedPayloadWidth = 3; // number of bytes for payload width
+const int snapshotAddr = 0; // EEPROM address of the snapshot
+unsigned char snapshot [NRF24L01P_SNAPSHOT_SIZE];
+
+unsigned long verifyTime = 0;
+// GLOBALS << GLOBALS  << GLOBALS  << GLOBALS  << GLOBALS
+
+void setup()
+{
+	Serial.begin(9600);
+	SPI.begin();
+	myRadio.begin();
+
+	for (int i=0; i<NRF24L01P_SNAPSHOT_SIZE; i++)
+	{snapshot[i] = EEPROM.read(snapshotAddr+i);}
+
+	unsigned long startTime = micros();
+	// The radio may have kept its configuration through an MCU reset, so write everything
+	if (myRadio.snapshotRestore(snapshot, 0))
+	{
+		Serial.print("restored from EEPROM us: ");
+		Serial.println(micros() - startTime);
+	}
+	else
+	{
+		// No valid snapshot yet, run the full setup and save it
+		unsigned char pipesOn [] = {0x01};
+		myRadio.setup_data_pipes(pipesOn, fixedPayloadWidth);
+		unsigned char tmpArr [] = {0xE7,0xE7,0xE7};
+		myRadio.writeRegister(RX_ADDR_P0,tmpArr, 3);
+		myRadio.rMode();
+		myRadio.clear_interrupts();
+		delay(100);
+
+		myRadio.snapshotSave(snapshot);
+		for (int i=0; i<NRF24L01P_SNAPSHOT_SIZE; i++)
+		{EEPROM.write(snapshotAddr+i, snapshot[i]);}
+		Serial.println("snapshot saved");
+	}
+	verifyTime = millis();
+}
+
+
+void loop()
+{
+	if (millis() - verifyTime >= 100)
+	{
+		if (!myRadio.snapshotVerify())
+		{
+			// A chip that reset holds its reset values, only the differences are written
+			unsigned long startTime = micros();
+			myRadio.snapshotRestore(snapshot, 1);
+			Serial.print("radio reset, restored us: ");
+			Serial.println(micros() - startTime);
+		}
+		verifyTime = millis();
+	}
+}
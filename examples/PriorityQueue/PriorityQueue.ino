@@ -0,0 +1,82 @@
+/* PriorityQueue
+
+	NOTES: Keeps the bulk queue saturated and queues an urgent frame every 100ms.
+		   Urgent frames preempt bulk frames waiting in the hardware TX FIFO, so
+		   they only wait for the one bulk frame already on the air.
+
+		   Every second the worst urgent latency (enqueue to TX_DS, us) and the
+		   number of frames sent per class are printed.
+
+		   Any receiver listening on txAddr with a fixedPayloadWidth pipe can be
+		   used on the other end (see RadioSlave).
+*/
+
+#include <nRF24L01_define_map.h>
+#include <nRF24L01p.h>
+#include <nRF24L01p_txqueue.h>
+#include <SPI.h>
+
+// GLOBALS >> GLOBALS  >> GLOBALS  >> GLOBALS  >> GLOBALS
+int CE_pin = 9;
+int CSN_pin = 10;
+NRF24L01p myRadio(CE_pin,CSN_pin);
+
+TXQ_frame urgentBuf [4];
+TXQ_frame bulkBuf [16];
+NRF24L01pTxQueue txQueue(myRadio, urgentBuf, 4, bulkBuf, 16);
+
+const int fixedPayloadWidth = 3; // number of bytes for payload width
+unsigned char txAddr [] = {0xE7,0xE7,0xE7};
+
+unsigned long urgentTime = 0;
+unsigned long reportTime = 0;
+// GLOBALS << GLOBALS  << GLOBALS  << GLOBALS  << GLOBALS
+
+void setup()
+{
+	Serial.begin(9600);
+	SPI.begin();
+	myRadio.begin();
+
+	unsigned char pipesOn [] = {0x01};
+	myRadio.setup_data_pipes(pipesOn, fixedPayloadWidth);
+	// Pipe 0 receives the ACKs, so it listens on the TX address
+	myRadio.writeRegister(RX_ADDR_P0, txAddr, 3);
+	myRadio.writeRegister(TX_ADDR, txAddr, 3);
+	txQueue.begin();
+
+	delay(100);
+	urgentTime = millis();
+	reportTime = millis();
+}
+
+
+void loop()
+{
+	// Saturating bulk load, refused frames are counted by getFullCount
+	unsigned char bulkData [] = {0x10, 0x00, 0x00};
+	txQueue.enqueue(TXQ_BULK, bulkData, fixedPayloadWidth, micros());
+
+	if (millis() - urgentTime >= 100)
+	{
+		unsigned char alarmData [] = {0xA0, 0x01, 0x00};
+		txQueue.enqueue(TXQ_URGENT, alarmData, fixedPayloadWidth, micros());
+		urgentTime = millis();
+	}
+
+	txQueue.service(micros());
+
+	if (millis() - reportTime >= 1000)
+	{
+		Serial.print("urgent worst us: ");
+		Serial.print(txQueue.getMaxLatency(TXQ_URGENT));
+		Serial.print(" urgent sent: ");
+		Serial.print(txQueue.getSentCount(TXQ_URGENT));
+		Serial.print(" bulk sent: ");
+		Serial.print(txQueue.getSentCount(TXQ_BULK));
+		Serial.print(" preempted: ");
+		Serial.println(txQueue.getPreemptCount());
+		txQueue.resetStats();
+		reportTime = millis();
+	}
+}
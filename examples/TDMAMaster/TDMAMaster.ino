@@ -0,0 +1,97 @@
+/* TDMAMaster
+
+	NOTES: Polls a set of slaves with the TDMA scheduler instead of on demand.
+		   Every slave gets a slot in turn. Slot lengths shrink to fit slaves that
+		   answer quickly and grow for slaves that miss their slot.
+
+		   Slave i listens on {i, 0xB5, 0xB5} and answers to masterAddr on the
+		   same channel with a fixedPayloadWidth payload (see RadioSlave).
+		   The first byte of the answer must be i, answers that arrive after
+		   the slot has moved on are dropped and counted as strays.
+
+		   Every 10 seconds p50/p90/p99 response latency (us) and missed slots
+		   are printed for each slave.
+
+		   Each slave entry takes about 40 bytes of RAM, 50 slaves needs a Mega.
+*/
+
+#include <nRF24L01_define_map.h>
+#include <nRF24L01p.h>
+#include <nRF24L01p_tdma.h>
+#include <SPI.h>
+
+// GLOBALS >> GLOBALS  >> GLOBALS  >> GLOBALS  >> GLOBALS
+int CE_pin = 9;
+int CSN_pin = 10;
+NRF24L01p myRadio(CE_pin,CSN_pin);
+
+const int slaveNum = 50; // number of slaves to poll
+TDMA_slave slaveTable [slaveNum];
+NRF24L01pTDMA scheduler(myRadio, slaveTable, slaveNum);
+
+const int fixedPayloadWidth = 3; // number of bytes for payload width
+unsigned char masterAddr [] = {0xE7,0xE7,0xE7};
+
+unsigned long reportTime = 0;
+// GLOBALS << GLOBALS  << GLOBALS  << GLOBALS  << GLOBALS
+
+void setup()
+{
+	Serial.begin(9600);
+	SPI.begin();
+	myRadio.begin();
+
+	// Slots between 1ms and 20ms
+	scheduler.begin(masterAddr, 3, fixedPayloadWidth, 1000, 20000);
+	for (int i=0; i<slaveNum; i++)
+	{
+		unsigned char slaveAddr [] = {(unsigned char)i, 0xB5, 0xB5};
+		scheduler.addSlave(slaveAddr, (unsigned char)i);
+	}
+
+	// MOSI Command byte for read signal: 0x01
+	unsigned char tmpQuery [] = {0x01, 0x01, 0x00};
+	scheduler.setQuery(tmpQuery);
+	scheduler.setResponseHandler(slaveResponse);
+
+	delay(100);
+	reportTime = millis();
+}
+
+
+void loop()
+{
+	scheduler.run(micros());
+
+	if (millis() - reportTime >= 10000)
+	{
+		for (int i=0; i<scheduler.getSlaveCount(); i++)
+		{
+			Serial.print(i);
+			Serial.print(" p50: ");
+			Serial.print(scheduler.getLatencyPercentile(i, 50));
+			Serial.print(" p90: ");
+			Serial.print(scheduler.getLatencyPercentile(i, 90));
+			Serial.print(" p99: ");
+			Serial.print(scheduler.getLatencyPercentile(i, 99));
+			Serial.print(" missed: ");
+			Serial.println(scheduler.getMissCount(i));
+		}
+		Serial.print("strays: ");
+		Serial.println(scheduler.getStrayCount());
+		scheduler.resetStats();
+		reportTime = millis();
+	}
+}
+
+
+//******* FUNCTIONS **************** FUNCTIONS ***************** FUNCTIONS ****************************
+
+/* slaveResponse
+Called by the scheduler with every slave response
+1st byte is the slave id, 2nd and 3rd are data
+*/
+void slaveResponse(int slave, unsigned char * data)
+{
+	// Handle the response here, keep it short so the next slot starts on time
+}
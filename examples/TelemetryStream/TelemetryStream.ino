@@ -0,0 +1,111 @@
+/* TelemetryStream
+
+	NOTES: Fire-and-forget telemetry to a shared broadcast address.
+		   The transmitter sends with W_TX_PAYLOAD_NO_ACK so no packet waits for an ACK
+		   or is retried. Every packet carries a sequence number so each receiver can
+		   count the packets it missed.
+
+		   Set radioMode to 0 on the transmitter and 1 on every receiver.
+		   Set ackedMode to 1 on the transmitter to compare against acked txData.
+		   In ackedMode only one receiver may ACK the broadcast (ackReceiver = 1),
+		   ACKs from several receivers collide and every packet would be retried.
+		   The transmitter prints packets per second, receivers print received/lost.
+*/
+
+#include <nRF24L01_define_map.h>
+#include <nRF24L01p.h>
+#include <SPI.h>
+
+// GLOBALS >> GLOBALS  >> GLOBALS  >> GLOBALS  >> GLOBALS
+int radioMode = 0; // radioMode = 1 for RX, 0 for TX
+int ackedMode = 0; // ackedMode = 1 sends with txData for comparison
+int ackReceiver = 0; // Set to 1 on exactly one receiver when the transmitter uses ackedMode
+int streamCopies = 1; // Send each packet 1-3 times for redundancy
+
+int CE_pin = 9;
+int CSN_pin = 10;
+NRF24L01p myRadio(CE_pin,CSN_pin);
+
+const int dataWidth = 2; // number of telemetry bytes per packet
+unsigned char broadcastAddr [] = {0xC2,0xC2,0xC2};
+
+unsigned long packetCount = 0;
+unsigned long reportTime = 0;
+// GLOBALS << GLOBALS  << GLOBALS  << GLOBALS  << GLOBALS
+
+void setup()
+{
+	Serial.begin(9600);
+	SPI.begin();
+	myRadio.begin();
+
+	// Pipe width is the telemetry bytes plus the sequence number
+	unsigned char pipesOn [] = {0x01};
+	myRadio.setup_data_pipes(pipesOn, dataWidth+1);
+	myRadio.writeRegister(RX_ADDR_P0, broadcastAddr, 3);
+	// 3-byte addresses, streamBegin sets the same width on the transmitter
+	unsigned char awArg [] = {0x01};
+	myRadio.writeRegister(SETUP_AW, awArg, 1);
+	myRadio.clear_interrupts();
+
+	if (radioMode)
+	{
+		// Every receiver but one stays silent so broadcast ACKs do not collide
+		unsigned char enAA [] = {(unsigned char)(ackReceiver ? 0x01 : 0x00)};
+		myRadio.writeRegister(EN_AA, enAA, 1);
+		myRadio.rMode();
+	}
+	else if (ackedMode)
+	{
+		myRadio.writeRegister(TX_ADDR, broadcastAddr, 3);
+		myRadio.txMode();
+	}
+	else
+	{myRadio.streamBegin(broadcastAddr, 3, streamCopies);}
+
+	delay(100);
+	reportTime = millis();
+}
+
+
+void loop()
+{
+	if (radioMode == 0)
+	{
+		unsigned char tmpData [] = {(unsigned char)packetCount, (unsigned char)(packetCount >> 8), 0x00};
+		if (ackedMode)
+		{
+			// Same payload as the stream, but every packet waits for its ACK
+			unsigned char tmpPacket [] = {(unsigned char)packetCount, tmpData[0], tmpData[1]};
+			myRadio.txData(tmpPacket, dataWidth+1);
+			myRadio.clear_interrupts();
+		}
+		else
+		{myRadio.streamSend(tmpData, dataWidth);} // Sends at most 4 data bytes
+		packetCount++;
+	}
+	else
+	{
+		// RX_EMPTY is bit 0 of FIFO_STATUS
+		while ((*myRadio.readRegister(FIFO_STATUS,1) & (1 << RX_EMPTY)) == 0)
+		{myRadio.streamReceive(dataWidth);}
+	}
+
+	if (millis() - reportTime >= 1000)
+	{
+		if (radioMode == 0)
+		{
+			Serial.print("packets/s: ");
+			Serial.println(packetCount);
+			packetCount = 0;
+		}
+		else
+		{
+			Serial.print("received: ");
+			Serial.print(myRadio.getStreamRxCount());
+			Serial.print(" lost: ");
+			Serial.println(myRadio.getStreamLostCount());
+		}
+		reportTime = millis();
+	}
+}
@@ -26,19 +26,25 @@
   #include "USART.h"
 #endif
 
-#include "NRF24L01p.h"
+#include "nRF24L01p.h"
 #include "nRF24L01_define_map.h"
 #include "string.h"
 #include "SPI.h"
 
-// Used to check the status of a given bit in a variable
-#define CHECK_BIT(var,pos) ((var & (1 << pos)) == (1 << pos))
-
 #ifdef ARDUINO
   NRF24L01p::NRF24L01p(int _cepin, int _csnpin)
   {
     ce_pin = _cepin;
     csn_pin = _csnpin;
+    stream_seq = 0;
+    stream_copies = 1;
+    stream_burst = 0;
+    resetStreamStats();
+    beacon_width = 0;
+    beacon_pending = 0;
+    beacon_sent_us = 0;
+    config_cache = NRF24L01P_CONFIG_RESET_VALUE;
+    ce_state = 0;
   }
 #else
   //NRF24L01p::NRF24L01p(int _cepin, int _csnpin)
@@ -46,6 +52,15 @@
   {
     //ce_pin = _cepin;
     //csn_pin = _csnpin;
+    stream_seq = 0;
+    stream_copies = 1;
+    stream_burst = 0;
+    resetStreamStats();
+    beacon_width = 0;
+    beacon_pending = 0;
+    beacon_sent_us = 0;
+    config_cache = NRF24L01P_CONFIG_RESET_VALUE;
+    ce_state = 0;
     initSPImaster();
   }
   
@@ -79,6 +94,7 @@
 #ifdef ARDUINO
   void NRF24L01p::digitalWrite_ce(bool val)
   {
+    ce_state = val;
     if (val == HIGH){
 	    digitalWrite(ce_pin, HIGH);
     }
@@ -90,6 +106,7 @@
   //digitalWrite function for ATMEL
   void NRF24L01p::digitalWrite_ce(bool val)
   {
+    ce_state = val;
     if (val == HIGH){
 	    SPI_CE_PORT |= (1 << SPI_CE);                       /* Write CSN pin HIGH */
     }
@@ -105,6 +122,16 @@
   {
     _delay_ms(val);
   }
+
+  // delayMicroseconds function for ATMEL
+  void NRF24L01p::delayMicroseconds(int val)
+  {
+    while (val > 0)
+    {
+      _delay_us(1);
+      val = val-1;
+    }
+  }
 #endif
 
 int NRF24L01p::get_ce_pin(void) 
@@ -201,6 +228,9 @@ void NRF24L01p::writeRegister(unsigned char thisRegister, unsigned char thisValu
 	// Must start with CSN pin high, then bring CSN pin low for the transfer
 	// Transmit the command byte
 	// Bring CSN pin back to high
+	// Keep a copy of CONFIG so snapshotVerify can spot a chip that reset
+	if (thisRegister == CONFIG)
+		config_cache = thisValue[0];
 	thisRegister = 0x20 | thisRegister;
 	//digitalWrite(csn_pin, LOW);
 	//SPI_CSN_PORT &= ~(1 << SPI_CSN);                      /* Write CNS pin LOW */
@@ -323,6 +353,17 @@ void NRF24L01p::txMode(void)
 	//SPI_CE_PORT &= ~(1 << SPI_CE);                      /* Write CE pin low */
   digitalWrite_ce(LOW);
 }
+
+/* txModeReady Transmit Mode, Ready
+One CONFIG read, the delay only happens when PWR_UP was clear
+*/
+void NRF24L01p::txModeReady(void)
+{
+	bool tmp_powered = CHECK_BIT(*readRegister(CONFIG, 1), PWR_UP);
+	txMode();
+	if (!tmp_powered)
+		delayMicroseconds(NRF24L01P_POWER_UP_US);
+}
 	
 /* rMode Receive Mode
 Put radio into receiving mode
@@ -348,31 +389,7 @@ void NRF24L01p::txData(unsigned char DATA [], int BYTE_NUM)
 	// First the command byte (0xA0, W_TX_PAYLOAD) is sent and then the payload. 
 	// The number of payload bytes sent must match the payload length of the receiver you are sending the payload to
 	
-	// Must start with CSN pin high, then bring CSN pin low for the transfer
-	// Transmit the command byte
-	// Bring CSN pin back to high
-	
-	//digitalWrite(csn_pin, LOW);
-	//SPI_CSN_PORT &= ~(1 << SPI_CSN);                      /* Write CNS pin LOW */
-  digitalWrite_csn(LOW);
-
-	SPI.transfer(W_TX_PAYLOAD); // This is the register that is being written to
-	int ind=0;
-	//Serial.println("DATA"); //DEBUG
-	while (ind < BYTE_NUM)
-	{
-		/*
-		//DEBUG
-		printString("Element ");
-		printWord(ind);
-		printString(": ");
-		printWord(DATA[ind]);
-		*/
-		SPI.transfer(DATA[ind]);
-		ind = ind+1;
-		
-	}
-	digitalWrite_csn(HIGH);                                 /* Write CSN pin HIGH */
+	write_payload(W_TX_PAYLOAD, DATA, BYTE_NUM);
 
 	// When sending packets, the CE pin (which is normally held low in TX operation) is set to high for a minimum of 10us to send the packet.
 	digitalWrite_ce(HIGH);
@@ -449,6 +466,8 @@ void NRF24L01p::flushTX(void)
 	digitalWrite_csn(LOW);
 	SPI.transfer(FLUSH_TX); // This is the register that is being written to
 	digitalWrite_csn(HIGH);
+	// FLUSH_TX also ends TX payload reuse
+	beacon_width = 0;
 }
 
 /* flushTX Flush TX FIFO
@@ -466,6 +485,439 @@ void NRF24L01p::flushRX(void)
 
 
 
+/* write_payload Write TX Payload
+Write a payload into the TX FIFO with either W_TX_PAYLOAD or W_TX_PAYLOAD_NO_ACK
+Payloads loaded back to back are sent in order, one per pulse_ce
+*/
+void NRF24L01p::write_payload(unsigned char command, unsigned char DATA [], int BYTE_NUM)
+{
+	// Must start with CSN pin high, then bring CSN pin low for the transfer
+	// Transmit the command byte
+	// Bring CSN pin back to high
+	digitalWrite_csn(LOW);
+	SPI.transfer(command); // This is the command that selects how the payload is sent
+	int ind=0;
+	while (ind < BYTE_NUM)
+	{
+		SPI.transfer(DATA[ind]);
+		ind = ind+1;
+	}
+	digitalWrite_csn(HIGH);
+	// A new payload ends TX payload reuse
+	beacon_width = 0;
+}
+
+
+/* pulse_ce Pulse CE
+Toggle CE high for a minimum of 10us to send the packet at the head of the TX FIFO
+*/
+void NRF24L01p::pulse_ce(void)
+{
+	digitalWrite_ce(HIGH);
+	delayMicroseconds(15);
+	digitalWrite_ce(LOW);
+}
+
+
+/* enable_dynamic_ack Enable Dynamic ACK
+Set or clear EN_DYN_ACK in the FEATURE register
+*/
+void NRF24L01p::enable_dynamic_ack(bool enable)
+{
+	unsigned char* tmp_FEATURE = readRegister(FEATURE, 1);
+	unsigned char tmp_val [] = {setBit(*tmp_FEATURE, EN_DYN_ACK, enable)};
+	writeRegister(FEATURE, tmp_val, 1);
+}
+
+
+/* txDataNoAck Transmit Data without ACK
+The receiver does not send an ACK and the packet is never retransmitted, so TX_DS is set as soon as it is on the air
+*/
+void NRF24L01p::txDataNoAck(unsigned char DATA [], int BYTE_NUM)
+{
+	write_payload(W_TX_PAYLOAD_NO_ACK, DATA, BYTE_NUM);
+	// No ACK wait, so a short CE pulse is all that is needed
+	pulse_ce();
+}
+
+
+/* streamBegin Begin NOACK Streaming
+Every receiver sets RX_ADDR_P0 to broadcastAddr with a pipe width of BYTE_NUM + 1
+*/
+void NRF24L01p::streamBegin(unsigned char broadcastAddr [], int addrWidth, int copies)
+{
+	if (copies < 1)
+		copies = 1;
+	if (copies > 3) // The TX FIFO is three levels deep
+		copies = 3;
+	stream_copies = copies;
+	stream_seq = 0;
+
+	enable_dynamic_ack(1);
+	writeRegister(TX_ADDR, broadcastAddr, addrWidth);
+	// AW 1-3 is a 3-5 byte address
+	unsigned char tmp_aw [] = {(unsigned char)(addrWidth-2)};
+	writeRegister(SETUP_AW, tmp_aw, 1);
+	txModeReady();
+	stream_burst = 0;
+}
+
+
+/* streamEnd End NOACK Streaming
+*/
+void NRF24L01p::streamEnd(void)
+{
+	stream_drain();
+}
+
+
+/* stream_drain Drain Stream
+Wait for the TX FIFO to empty and bring CE low, the radio goes back to standby-I
+*/
+void NRF24L01p::stream_drain(void)
+{
+	if (stream_burst == 0)
+		return;
+	while (!CHECK_BIT(*readRegister(FIFO_STATUS, 1), TX_EMPTY))
+	{
+	}
+	digitalWrite_ce(LOW);
+	stream_burst = 0;
+}
+
+
+/* streamSend Send Stream Packet
+First byte on the air is the sequence number, followed by BYTE_NUM bytes of DATA
+CE stays high between calls so packets go out back to back from the TX FIFO.
+The TX PLL runs open loop in TX mode and must not stay there for more than 4ms (spec 6.1.5),
+so after NRF24L01P_STREAM_BURST packets the FIFO is drained and CE is brought low.
+*/
+bool NRF24L01p::streamSend(unsigned char DATA [], int BYTE_NUM)
+{
+	if (BYTE_NUM < 1 || BYTE_NUM > 4)
+		return 0;
+
+	unsigned char tmp_packet [5];
+	tmp_packet[0] = stream_seq;
+	int ind = 0;
+	while (ind < BYTE_NUM)
+	{
+		tmp_packet[ind+1] = DATA[ind];
+		ind = ind+1;
+	}
+
+	int copy = 0;
+	while (copy < stream_copies)
+	{
+		if (stream_burst >= NRF24L01P_STREAM_BURST)
+			stream_drain();
+		// Wait for room in the TX FIFO
+		while (CHECK_BIT(*readRegister(FIFO_STATUS, 1), FIFO_FULL))
+		{
+		}
+		write_payload(W_TX_PAYLOAD_NO_ACK, tmp_packet, BYTE_NUM+1);
+		if (stream_burst == 0)
+			digitalWrite_ce(HIGH);
+		stream_burst = stream_burst+1;
+		copy = copy+1;
+	}
+
+	// Clear TX_DS so the IRQ pin does not stay asserted between packets
+	unsigned char tmp_state [] = {1<<TX_DS};
+	writeRegister(STATUS, tmp_state, 1);
+
+	stream_seq = stream_seq+1; // Wraps at 255
+	return 1;
+}
+
+
+/* streamReceive Receive Stream Packet
+Sequence gaps are counted as lost packets, repeated sequence numbers are redundant copies
+*/
+unsigned char * NRF24L01p::streamReceive(int byteNum)
+{
+	// register_value holds the sequence number plus at most 4 data bytes
+	if (byteNum > 4)
+		byteNum = 4;
+	if (byteNum < 1)
+		byteNum = 1;
+	unsigned char * tmp_packet = rData(byteNum+1);
+	unsigned char tmp_seq = tmp_packet[0];
+
+	if (stream_synced)
+	{
+		if (tmp_seq == stream_last_seq)
+			return 0; // Redundant copy of a packet already received
+
+		// Number of sequence numbers skipped, modulo 256
+		unsigned char tmp_gap = (unsigned char)(tmp_seq - stream_last_seq - 1);
+		stream_lost_count = stream_lost_count + tmp_gap;
+	}
+	stream_synced = 1;
+	stream_last_seq = tmp_seq;
+	stream_rx_count = stream_rx_count+1;
+
+	return tmp_packet+1;
+}
+
+
+unsigned long NRF24L01p::getStreamRxCount(void)
+{
+	return stream_rx_count;
+}
+
+unsigned long NRF24L01p::getStreamLostCount(void)
+{
+	return stream_lost_count;
+}
+
+void NRF24L01p::resetStreamStats(void)
+{
+	stream_synced = 0;
+	stream_last_seq = 0;
+	stream_rx_count = 0;
+	stream_lost_count = 0;
+}
+
+
+
+/* beaconBegin Begin Beacon Mode
+Every NOACK beacon sets TX_DS, so TX_DS is masked from the IRQ pin instead of being cleared after each beacon
+*/
+void NRF24L01p::beaconBegin(unsigned char beaconAddr [], int addrWidth)
+{
+	enable_dynamic_ack(1);
+	writeRegister(TX_ADDR, beaconAddr, addrWidth);
+	// AW 1-3 is a 3-5 byte address
+	unsigned char tmp_aw [] = {(unsigned char)(addrWidth-2)};
+	writeRegister(SETUP_AW, tmp_aw, 1);
+	txModeReady();
+	unsigned char tmp_config [] = {setBit(*readRegister(CONFIG, 1), MASK_TX_DS, 1)};
+	writeRegister(CONFIG, tmp_config, 1);
+	beacon_width = 0;
+	beacon_pending = 0;
+}
+
+
+/* beaconLoad Load Beacon Payload
+A new payload costs FLUSH_TX + W_TX_PAYLOAD_NO_ACK + REUSE_TX_PL + clearing TX_DS (BYTE_NUM + 5 SPI bytes)
+An unchanged payload costs nothing
+*/
+bool NRF24L01p::beaconLoad(unsigned char DATA [], int BYTE_NUM)
+{
+	if (BYTE_NUM < 1 || BYTE_NUM > 5)
+		return 0;
+	if (BYTE_NUM == beacon_width && memcmp(DATA, beacon_payload, BYTE_NUM) == 0)
+		return 1;
+
+	// TX payload reuse must not be activated or deactivated during a transmission
+	// Only wait for the part of the last beacon's airtime that is left
+	if (beacon_pending)
+	{
+	  #ifdef ARDUINO
+		unsigned long tmp_elapsed = micros() - beacon_sent_us;
+		if (tmp_elapsed < NRF24L01P_BEACON_AIRTIME_US)
+			delayMicroseconds(NRF24L01P_BEACON_AIRTIME_US - tmp_elapsed);
+	  #else
+		delayMicroseconds(NRF24L01P_BEACON_AIRTIME_US);
+	  #endif
+	}
+
+	// FLUSH_TX ends reuse of the old payload, otherwise the new payload would queue behind it
+	flushTX();
+	write_payload(W_TX_PAYLOAD_NO_ACK, DATA, BYTE_NUM);
+
+	digitalWrite_csn(LOW);
+	SPI.transfer(REUSE_TX_PL);
+	digitalWrite_csn(HIGH);
+
+	// TX_DS is masked in beacon mode, clear the flag left by the old payload
+	unsigned char tmp_state [] = {1<<TX_DS};
+	writeRegister(STATUS, tmp_state, 1);
+
+	memcpy(beacon_payload, DATA, BYTE_NUM);
+	beacon_width = BYTE_NUM;
+	beacon_pending = 0;
+	return 1;
+}
+
+
+/* beaconSend Send Beacon
+While TX_REUSE is set the payload stays in the TX FIFO and every CE pulse sends it again
+TX_DS is left set, it is masked from the IRQ pin by beaconBegin
+*/
+void NRF24L01p::beaconSend(void)
+{
+	pulse_ce();
+	beacon_pending = 1;
+  #ifdef ARDUINO
+	beacon_sent_us = micros();
+  #endif
+}
+
+
+/* beaconActive Beacon Active
+*/
+bool NRF24L01p::beaconActive(void)
+{
+	return CHECK_BIT(*readRegister(FIFO_STATUS, 1), TX_REUSE);
+}
+
+
+
+// Single byte registers in a snapshot, in restore order
+// CONFIG is kept apart so PWR_UP is written last
+static const unsigned char snapshot_registers [] = {EN_AA, EN_RXADDR, SETUP_AW, SETUP_RETR, RF_CH, RF_SETUP,
+	RX_ADDR_P2, RX_ADDR_P3, RX_ADDR_P4, RX_ADDR_P5, RX_PW_P0, RX_PW_P1, RX_PW_P2, RX_PW_P3, RX_PW_P4, RX_PW_P5,
+	DYNPD, FEATURE};
+// Power-on reset value of each entry in snapshot_registers
+static const unsigned char snapshot_defaults [] = {0x3F, 0x03, 0x03, 0x03, 0x02, 0x0E,
+	0xC3, 0xC4, 0xC5, 0xC6, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00};
+#define SNAPSHOT_REG_NUM ((int)sizeof(snapshot_registers))
+
+// 5-byte address registers in a snapshot and their reset values (LSByte first)
+static const unsigned char snapshot_addresses [] = {RX_ADDR_P0, RX_ADDR_P1, TX_ADDR};
+static const unsigned char snapshot_address_defaults [] = {0xE7, 0xC2, 0xE7};
+#define SNAPSHOT_ADDR_NUM ((int)sizeof(snapshot_addresses))
+
+// Blob layout
+#define SNAPSHOT_VERSION 0x01
+#define SNAPSHOT_REGS    1
+#define SNAPSHOT_ADDRS   (SNAPSHOT_REGS + SNAPSHOT_REG_NUM)
+#define SNAPSHOT_CONFIG  (SNAPSHOT_ADDRS + 5*SNAPSHOT_ADDR_NUM)
+#define SNAPSHOT_CE      (SNAPSHOT_CONFIG + 1)
+#define SNAPSHOT_SUM     (SNAPSHOT_CE + 1)
+
+
+/* snapshot_index Snapshot Register Index
+Position of a register in snapshot_registers, so the blob offset follows the table
+Returns -1 if the register is not in a snapshot
+*/
+static int snapshot_index(unsigned char reg)
+{
+	int ind = 0;
+	while (ind < SNAPSHOT_REG_NUM)
+	{
+		if (snapshot_registers[ind] == reg)
+			return ind;
+		ind = ind+1;
+	}
+	return -1;
+}
+
+
+/* snapshot_sum Snapshot Checksum
+Sum of every byte before the checksum, so a blank or corrupted EEPROM is rejected
+*/
+static unsigned char snapshot_sum(unsigned char blob [])
+{
+	unsigned char tmp_sum = 0x5A;
+	int ind = 0;
+	while (ind < SNAPSHOT_SUM)
+	{
+		tmp_sum = tmp_sum + blob[ind];
+		ind = ind+1;
+	}
+	return tmp_sum;
+}
+
+
+/* snapshotSave Save Configuration Snapshot
+Reads the configuration back from the chip, so writes made with writeRegister are included
+*/
+void NRF24L01p::snapshotSave(unsigned char blob [])
+{
+	blob[0] = SNAPSHOT_VERSION;
+
+	int ind = 0;
+	while (ind < SNAPSHOT_REG_NUM)
+	{
+		blob[SNAPSHOT_REGS + ind] = *readRegister(snapshot_registers[ind], 1);
+		ind = ind+1;
+	}
+
+	ind = 0;
+	while (ind < SNAPSHOT_ADDR_NUM)
+	{
+		unsigned char * tmp_addr = readRegister(snapshot_addresses[ind], 5);
+		memcpy(&blob[SNAPSHOT_ADDRS + 5*ind], tmp_addr, 5);
+		ind = ind+1;
+	}
+
+	blob[SNAPSHOT_CONFIG] = *readRegister(CONFIG, 1);
+	blob[SNAPSHOT_CE] = ce_state;
+	blob[SNAPSHOT_SUM] = snapshot_sum(blob);
+}
+
+
+/* snapshotRestore Restore Configuration Snapshot
+Order: CE low, registers, addresses, flush FIFOs, clear STATUS, CONFIG, CE
+*/
+bool NRF24L01p::snapshotRestore(unsigned char blob [], bool fromReset)
+{
+	if (blob[0] != SNAPSHOT_VERSION || blob[SNAPSHOT_SUM] != snapshot_sum(blob))
+		return 0;
+
+	digitalWrite_ce(LOW);
+
+	int ind = 0;
+	while (ind < SNAPSHOT_REG_NUM)
+	{
+		unsigned char tmp_val [] = {blob[SNAPSHOT_REGS + ind]};
+		if (!fromReset || tmp_val[0] != snapshot_defaults[ind])
+			writeRegister(snapshot_registers[ind], tmp_val, 1);
+		ind = ind+1;
+	}
+
+	// SETUP_AW is restored above, AW 1-3 is a 3-5 byte address
+	int tmp_width = (blob[SNAPSHOT_REGS + snapshot_index(SETUP_AW)] & 0x03) + 2;
+	ind = 0;
+	while (ind < SNAPSHOT_ADDR_NUM)
+	{
+		unsigned char * tmp_addr = &blob[SNAPSHOT_ADDRS + 5*ind];
+		bool tmp_default = 1;
+		int byte_ind = 0;
+		while (byte_ind < tmp_width)
+		{
+			if (tmp_addr[byte_ind] != snapshot_address_defaults[ind])
+				tmp_default = 0;
+			byte_ind = byte_ind+1;
+		}
+		// One burst per address
+		if (!fromReset || !tmp_default)
+			writeRegister(snapshot_addresses[ind], tmp_addr, tmp_width);
+		ind = ind+1;
+	}
+
+	flushTX();
+	flushRX();
+	// Clear all interrupts in one write
+	unsigned char tmp_state [] = {(1<<RX_DR) | (1<<TX_DS) | (1<<MAX_RT)};
+	writeRegister(STATUS, tmp_state, 1);
+
+	bool tmp_powering_up = !CHECK_BIT(*readRegister(CONFIG, 1), PWR_UP) && CHECK_BIT(blob[SNAPSHOT_CONFIG], PWR_UP);
+	unsigned char tmp_config [] = {blob[SNAPSHOT_CONFIG]};
+	writeRegister(CONFIG, tmp_config, 1);
+	// Power down to standby before CE may go high
+	if (tmp_powering_up)
+		delayMicroseconds(NRF24L01P_POWER_UP_US);
+
+	digitalWrite_ce(blob[SNAPSHOT_CE]);
+	return 1;
+}
+
+
+/* snapshotVerify Verify Configuration
+One CONFIG read, a chip that reset reads back 0x08 instead of the cached value
+*/
+bool NRF24L01p::snapshotVerify(void)
+{
+	return *readRegister(CONFIG, 1) == config_cache;
+}
+
+
+
 //NRF24L01p NRF24L01p;
 
 
@@ -15,6 +15,28 @@
 // TODO
 // Protected vs private variables (incl _private variable names)
 
+// Packets streamSend sends back to back before draining the TX FIFO and dropping CE
+// 6 packets of 5 bytes at 250kbps stay well under the 4ms TX mode limit
+#define NRF24L01P_STREAM_BURST 6
+
+// Number of bytes in a configuration snapshot, see snapshotSave
+#define NRF24L01P_SNAPSHOT_SIZE 37
+
+// Power down to standby, CE must stay low this long after PWR_UP is set (Tpd2stby)
+#define NRF24L01P_POWER_UP_US 1500
+
+// Longest time one beacon is on the air: 130us settling plus a 5-byte payload
+// with a 5-byte address at 250kbps, rounded up
+#define NRF24L01P_BEACON_AIRTIME_US 600
+
+// CONFIG register value after power-on reset
+#define NRF24L01P_CONFIG_RESET_VALUE 0x08
+
+// Used to check the status of a given bit in a variable
+#ifndef CHECK_BIT
+  #define CHECK_BIT(var,pos) ((var & (1 << pos)) == (1 << pos))
+#endif
+
 class NRF24L01p
 {
  protected:
@@ -26,7 +48,23 @@ class NRF24L01p
 	int pipe0_reading_address[5]; // Last address set on pipe 0 for reading
 	int addr_width; // The address width to use - 3,4,or 5 bytes
 	unsigned char register_value [6]; // The value of the last register read
-	
+
+	unsigned char stream_seq; // Sequence number of the next streamed packet
+	int stream_copies; // Number of times each streamed packet is sent, 1-3
+	int stream_burst; // Packets loaded since CE went high, 0 while CE is low
+	unsigned char stream_last_seq; // Last sequence number received from the stream
+	bool stream_synced; // Set once the first stream packet has been received
+	unsigned long stream_rx_count; // Number of unique stream packets received
+	unsigned long stream_lost_count; // Number of stream packets missed (sequence gaps)
+
+	unsigned char beacon_payload [5]; // Payload currently held in the TX FIFO for reuse
+	int beacon_width; // Number of bytes in beacon_payload, 0 if no beacon is loaded
+	bool beacon_pending; // Set when a beacon was sent since the last load
+	unsigned long beacon_sent_us; // Time of the last beaconSend (us)
+
+	unsigned char config_cache; // Last value written to CONFIG
+	bool ce_state; // Current level of the CE pin
+
 	int debug_val;
 
  public:
@@ -110,6 +148,12 @@ class NRF24L01p
 	Put radio into transmission mode
 	*/
 	void txMode(void);
+
+	/* txModeReady Transmit Mode, Ready
+	Put radio into transmission mode and wait out the power-up delay if it was powered down
+	Returns once CE may go high
+	*/
+	void txModeReady(void);
 	
 	/* rMode Receive Mode
 	Put radio into receiving mode
@@ -122,6 +166,19 @@ class NRF24L01p
 	@param BYTE_NUM is the number of bytes to transmit 1-5
 	*/
 	void txData(unsigned char DATA [5], int BYTE_NUM);
+
+	/* write_payload Write TX Payload
+	Write a payload into the 3-level TX FIFO without sending it
+	@param command is W_TX_PAYLOAD or W_TX_PAYLOAD_NO_ACK
+	@param DATA is the data to transmit
+	@param BYTE_NUM is the number of bytes to transmit 1-5
+	*/
+	void write_payload(unsigned char command, unsigned char DATA [], int BYTE_NUM);
+
+	/* pulse_ce Pulse CE
+	Toggle CE high for >10us to send the packet at the head of the TX FIFO, TX_DS or MAX_RT is set when it is done
+	*/
+	void pulse_ce(void);
 	
 	
 	/* rData Receive Data
@@ -141,7 +198,116 @@ class NRF24L01p
 	*/
 	void flushRX(void);
 
-    
+
+	/* enable_dynamic_ack Enable Dynamic ACK
+	Set or clear EN_DYN_ACK in the FEATURE register
+	Must be set before txDataNoAck is used
+	@param enable 1:Allow W_TX_PAYLOAD_NO_ACK 0:Every packet is acknowledged
+	*/
+	void enable_dynamic_ack(bool enable);
+
+	/* txDataNoAck Transmit Data without ACK
+	Transmit data with the NO_ACK flag set, the receiver does not acknowledge it and it is never retransmitted
+	@param DATA is the data to transmit
+	@param BYTE_NUM is the number of bytes to transmit 1-5
+	*/
+	void txDataNoAck(unsigned char DATA [5], int BYTE_NUM);
+
+	/* streamBegin Begin NOACK Streaming
+	Enable dynamic ACK, point TX_ADDR at the broadcast address and put the radio into transmit mode
+	Receivers listen on the same address in their RX_ADDR_P0, with the same SETUP_AW
+	The pipe width on the receivers must be BYTE_NUM + 1 (the sequence number is the first byte)
+	@param broadcastAddr is the shared address every receiver listens on
+	@param addrWidth is the number of address bytes 3-5, written to SETUP_AW
+	@param copies is the number of times each packet is sent, 1-3 (2 or 3 adds redundancy)
+	*/
+	void streamBegin(unsigned char broadcastAddr [], int addrWidth, int copies);
+
+	/* streamEnd End NOACK Streaming
+	Wait for the TX FIFO to empty and bring CE low
+	*/
+	void streamEnd(void);
+
+	/* streamSend Send Stream Packet
+	Prepend the sequence number and send the packet without ACK
+	@param DATA is the data to transmit
+	@param BYTE_NUM is the number of bytes to transmit 1-4
+	Returns 0 and sends nothing if BYTE_NUM is outside 1-4
+	*/
+	bool streamSend(unsigned char DATA [], int BYTE_NUM);
+
+	/* streamReceive Receive Stream Packet
+	Read a stream packet and update the receive and loss counters
+	Redundant copies of a packet already received are dropped
+	@param byteNum is the number of data bytes 1-4, not counting the sequence number
+	Returns a pointer to the data bytes or 0 if the packet was a duplicate
+	*/
+	unsigned char * streamReceive(int byteNum);
+
+	/* Stream statistics
+	Loss rate is lost / (received + lost)
+	*/
+	unsigned long getStreamRxCount(void);
+	unsigned long getStreamLostCount(void);
+	void resetStreamStats(void);
+
+
+	/* beaconBegin Begin Beacon Mode
+	Enable dynamic ACK, point TX_ADDR at the beacon address and put the radio into transmit mode
+	TX_DS is masked from the IRQ pin until the next txMode or rMode
+	@param beaconAddr is the address the beacon is sent to
+	@param addrWidth is the number of address bytes 3-5, written to SETUP_AW
+	*/
+	void beaconBegin(unsigned char beaconAddr [], int addrWidth);
+
+	/* beaconLoad Load Beacon Payload
+	Upload the payload once and mark it for reuse with REUSE_TX_PL
+	Does nothing if the payload is the same as the one already loaded
+	Waits for the rest of the last beacon's airtime if it may still be on the air
+	@param DATA is the beacon payload
+	@param BYTE_NUM is the number of bytes in the payload 1-5
+	Returns 0 and loads nothing if BYTE_NUM is outside 1-5
+	*/
+	bool beaconLoad(unsigned char DATA [5], int BYTE_NUM);
+
+	/* beaconSend Send Beacon
+	Retransmit the loaded payload with a CE pulse, no SPI transfer is needed
+	The TX_DS flag is not cleared, read STATUS only after clearing it yourself
+	*/
+	void beaconSend(void);
+
+	/* beaconActive Beacon Active
+	Returns 1 if TX_REUSE is set in FIFO_STATUS
+	TX_REUSE is cleared by W_TX_PAYLOAD or FLUSH_TX (txData, clear_interrupts, ...), reload the beacon if this returns 0
+	*/
+	bool beaconActive(void);
+
+
+	/* snapshotSave Save Configuration Snapshot
+	Serialize the configuration registers, pipe addresses, channel, feature bits and CE level
+	The blob can be kept in RAM or EEPROM
+	@param blob receives NRF24L01P_SNAPSHOT_SIZE bytes
+	*/
+	void snapshotSave(unsigned char blob []);
+
+	/* snapshotRestore Restore Configuration Snapshot
+	Replay a snapshot, CONFIG is written last and CE is set to the saved level
+	@param blob is a snapshot from snapshotSave
+	@param fromReset 1:Skip registers whose saved value equals the power-on default, the chip is not read
+	                 0:Write everything
+	Only set fromReset after snapshotVerify has failed, otherwise registers changed since
+	power-on but saved at their default are left as they are
+	Returns 0 if the blob is not a valid snapshot
+	*/
+	bool snapshotRestore(unsigned char blob [], bool fromReset);
+
+	/* snapshotVerify Verify Configuration
+	Compare CONFIG against the last value written to it
+	Returns 0 if the chip has silently reset (brownout) and needs snapshotRestore
+	*/
+	bool snapshotVerify(void);
+
+
  private:
   /* override functios to write to pins in either AVR or Arduino
    * */
@@ -149,8 +315,13 @@ class NRF24L01p
 
   void digitalWrite_ce(bool val);
 
+  /* wait for the TX FIFO to empty and bring CE low after a stream burst
+   * */
+  void stream_drain(void);
+
   #ifndef ARDUINO
     void delay(int val);
+    void delayMicroseconds(int val);
   #endif
 
 };
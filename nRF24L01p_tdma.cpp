@@ -0,0 +1,374 @@
+/* nRF24L01p_tdma.cpp - TDMA polling scheduler for the NRF24L01p library
+	Released to the public domain.
+
+ Slot sequence
+	Clear STATUS, flush both FIFOs
+	txMode, load the query and pulse CE
+	TX_DS: rMode, the slot length is counted from here
+	MAX_RT: the slave did not hear the query, count a miss and move on
+	Neither within maxSlot_us: the CE pulse was lost or the chip reset, count a miss
+	Every slot starts with a CONFIG check, a chip that reset gets the scheduler's
+	registers written again and the query waits out the power-up delay
+	Load the next slave's address into TX_ADDR and RX_ADDR_P0 while this slave answers
+	End the slot on a response with this slave's id or when the slot length runs out
+
+ Each call to run does one step of this sequence, so it never waits on the radio
+ and never changes PRIM_RX while the query or its retransmits are on the air
+*/
+
+#include "nRF24L01p_tdma.h"
+#include "nRF24L01_define_map.h"
+
+NRF24L01pTDMA::NRF24L01pTDMA(NRF24L01p & _radio, TDMA_slave slaveTable [], int maxSlaves)
+{
+	radio = &_radio;
+	slaves = slaveTable;
+	max_slaves = maxSlaves;
+	slave_count = 0;
+	addr_width = 3;
+	payload_width = 1;
+	query[0] = 0x01;
+	current = -1;
+	phase = TDMA_QUERY;
+	next_loaded = -1;
+	slot_start = 0;
+	phase_start = 0;
+	stray_count = 0;
+	min_slot_us = 0;
+	max_slot_us = 0;
+	response_handler = 0;
+}
+
+
+bool NRF24L01pTDMA::begin(unsigned char masterAddr [], int addrWidth, int payloadWidth, unsigned long minSlot_us, unsigned long maxSlot_us)
+{
+	// query and the radio's register_value hold at most 5 payload bytes
+	if (payloadWidth < 1 || payloadWidth > 5)
+		return 0;
+
+	addr_width = addrWidth;
+	payload_width = payloadWidth;
+	min_slot_us = minSlot_us;
+	max_slot_us = maxSlot_us;
+	int ind = 0;
+	while (ind < 5)
+	{
+		master_address[ind] = (ind < addrWidth) ? masterAddr[ind] : 0;
+		ind = ind+1;
+	}
+
+	setup_radio();
+	radio->txModeReady();
+
+	current = -1;
+	next_loaded = -1;
+	return 1;
+}
+
+
+/* setup_radio Setup Radio
+Every register the scheduler depends on, written by begin and again after the chip resets
+*/
+void NRF24L01pTDMA::setup_radio(void)
+{
+	// Pipe 0 receives the ACK for the query, pipe 1 receives the response
+	unsigned char pipesOn [] = {(1<<ERX_P0) | (1<<ERX_P1)};
+	radio->setup_data_pipes(pipesOn, payload_width);
+	unsigned char widthArg [] = {(unsigned char)payload_width};
+	radio->writeRegister(RX_PW_P1, widthArg, 1);
+	radio->writeRegister(RX_ADDR_P1, master_address, addr_width);
+	// AW 1-3 is a 3-5 byte address
+	unsigned char awArg [] = {(unsigned char)(addr_width-2)};
+	radio->writeRegister(SETUP_AW, awArg, 1);
+}
+
+
+int NRF24L01pTDMA::addSlave(unsigned char address [], unsigned char id)
+{
+	if (slave_count >= max_slaves)
+		return -1;
+
+	TDMA_slave * s = &slaves[slave_count];
+	int ind = 0;
+	while (ind < 5)
+	{
+		s->address[ind] = (ind < addr_width) ? address[ind] : 0;
+		ind = ind+1;
+	}
+	s->id = id;
+	s->slot_us = max_slot_us;
+	s->avg_us = 0;
+	s->max_us = 0;
+	ind = 0;
+	while (ind < TDMA_HIST_BUCKETS)
+	{
+		s->hist[ind] = 0;
+		ind = ind+1;
+	}
+	s->responses = 0;
+	s->misses = 0;
+
+	slave_count = slave_count+1;
+	return slave_count-1;
+}
+
+
+void NRF24L01pTDMA::setQuery(unsigned char DATA [])
+{
+	int ind = 0;
+	while (ind < payload_width)
+	{
+		query[ind] = DATA[ind];
+		ind = ind+1;
+	}
+}
+
+
+void NRF24L01pTDMA::setResponseHandler(void (*handler)(int slave, unsigned char * data))
+{
+	response_handler = handler;
+}
+
+
+void NRF24L01pTDMA::run(unsigned long now_us)
+{
+	if (slave_count == 0)
+		return;
+
+	if (current < 0)
+	{
+		start_slot(0, now_us);
+		return;
+	}
+
+	if (phase == TDMA_WAKE)
+	{
+		if (now_us - phase_start >= NRF24L01P_POWER_UP_US)
+			start_slot(current, now_us);
+		return;
+	}
+
+	unsigned char tmp_status = *radio->readRegister(STATUS, 1);
+	if (phase == TDMA_QUERY)
+	{
+		if (CHECK_BIT(tmp_status, TX_DS))
+		{
+			// The query is on the slave, turn around and start the slot
+			unsigned char tmp_state [] = {1<<TX_DS};
+			radio->writeRegister(STATUS, tmp_state, 1);
+			radio->rMode();
+			slot_start = now_us;
+			phase = TDMA_LISTEN;
+
+			// The next slave's address is written while this one is answering
+			if (slave_count > 1)
+				load_address((current+1) % slave_count);
+		}
+		else if (CHECK_BIT(tmp_status, MAX_RT))
+		{
+			// No ACK after every retransmit, the slave is out of range or off
+			slaves[current].misses = slaves[current].misses+1;
+			start_slot((current+1) % slave_count, now_us);
+		}
+		else if (now_us - phase_start >= max_slot_us)
+		{
+			// Neither flag came up: the CE pulse was lost or the chip has reset
+			slaves[current].misses = slaves[current].misses+1;
+			start_slot((current+1) % slave_count, now_us);
+		}
+		return;
+	}
+
+	if (CHECK_BIT(tmp_status, RX_DR) && read_responses(now_us))
+	{
+		end_slot(now_us, 1);
+	}
+	else if (now_us - slot_start >= slaves[current].slot_us)
+	{
+		end_slot(now_us, 0);
+	}
+}
+
+
+/* load_address Load Slave Address
+TX_ADDR and RX_ADDR_P0 must match for the query to be acknowledged
+*/
+void NRF24L01pTDMA::load_address(int slave)
+{
+	radio->writeRegister(TX_ADDR, slaves[slave].address, addr_width);
+	radio->writeRegister(RX_ADDR_P0, slaves[slave].address, addr_width);
+	next_loaded = slave;
+}
+
+
+/* start_slot Start Slot
+Load the query and pulse CE, run picks up TX_DS or MAX_RT
+After a chip reset the slot starts in TDMA_WAKE instead and run retries it after the power-up delay
+*/
+void NRF24L01pTDMA::start_slot(int slave, unsigned long now_us)
+{
+	current = slave;
+
+	// A chip that reset (brownout) is powered down with reset values, a CE pulse now would be lost
+	if (!radio->snapshotVerify())
+	{
+		next_loaded = -1;
+		setup_radio();
+		radio->txMode();
+		phase = TDMA_WAKE;
+		phase_start = now_us;
+		return;
+	}
+	if (next_loaded != slave)
+		load_address(slave);
+
+	// Clear all interrupts in one write and drop anything left over from the last slot
+	unsigned char tmp_state [] = {(1<<RX_DR) | (1<<TX_DS) | (1<<MAX_RT)};
+	radio->writeRegister(STATUS, tmp_state, 1);
+	radio->flushTX();
+	radio->flushRX();
+
+	radio->txMode();
+	radio->write_payload(W_TX_PAYLOAD, query, payload_width);
+	radio->pulse_ce();
+	phase = TDMA_QUERY;
+	phase_start = now_us;
+}
+
+
+/* read_responses Read Responses
+Drain the RX FIFO, a late answer from the previous slave must not be credited to this one
+Returns 1 if the slave that owns the slot answered
+*/
+bool NRF24L01pTDMA::read_responses(unsigned long now_us)
+{
+	TDMA_slave * s = &slaves[current];
+	unsigned char tmp_state [] = {1<<RX_DR};
+	radio->writeRegister(STATUS, tmp_state, 1);
+
+	// RX_P_NO is 7 when the RX FIFO is empty
+	unsigned char tmp_pipe = (*radio->readRegister(STATUS, 1) >> RX_P_NO) & 0x07;
+	while (tmp_pipe != 0x07)
+	{
+		unsigned char * tmp_data = radio->rData(payload_width);
+		if (tmp_pipe == 1 && tmp_data[0] == s->id)
+		{
+			record_latency(s, now_us - slot_start);
+			if (response_handler)
+				response_handler(current, tmp_data);
+			return 1;
+		}
+		stray_count = stray_count+1;
+		tmp_pipe = (*radio->readRegister(STATUS, 1) >> RX_P_NO) & 0x07;
+	}
+	return 0;
+}
+
+
+/* end_slot End Slot
+Adapt the slot length and hand the air to the next slave
+Answered slots shrink towards twice the smoothed response time, missed slots double
+*/
+void NRF24L01pTDMA::end_slot(unsigned long now_us, bool answered)
+{
+	TDMA_slave * s = &slaves[current];
+	if (answered)
+	{
+		s->slot_us = 2*s->avg_us;
+	}
+	else
+	{
+		s->misses = s->misses+1;
+		s->slot_us = 2*s->slot_us;
+	}
+	if (s->slot_us < min_slot_us)
+		s->slot_us = min_slot_us;
+	if (s->slot_us > max_slot_us)
+		s->slot_us = max_slot_us;
+
+	start_slot((current+1) % slave_count, now_us);
+}
+
+
+void NRF24L01pTDMA::record_latency(TDMA_slave * s, unsigned long latency_us)
+{
+	// Smoothed response time, weight 1/8 on the new sample
+	if (s->responses == 0)
+		s->avg_us = latency_us;
+	else
+		s->avg_us = s->avg_us - s->avg_us/8 + latency_us/8;
+	if (latency_us > s->max_us)
+		s->max_us = latency_us;
+
+	int bucket = 0;
+	while (bucket < TDMA_HIST_BUCKETS-1 && latency_us >= ((unsigned long)TDMA_HIST_BASE_US << bucket))
+		bucket = bucket+1;
+	s->hist[bucket] = s->hist[bucket]+1;
+	s->responses = s->responses+1;
+}
+
+
+unsigned long NRF24L01pTDMA::getLatencyPercentile(int slave, int percentile)
+{
+	TDMA_slave * s = &slaves[slave];
+	if (s->responses == 0)
+		return 0;
+
+	// Rank of the percentile sample, rounded up
+	unsigned long rank = ((unsigned long)s->responses * percentile + 99) / 100;
+	unsigned long count = 0;
+	int bucket = 0;
+	while (bucket < TDMA_HIST_BUCKETS-1)
+	{
+		count = count + s->hist[bucket];
+		if (count >= rank)
+			return (unsigned long)TDMA_HIST_BASE_US << bucket;
+		bucket = bucket+1;
+	}
+	return s->max_us;
+}
+
+unsigned long NRF24L01pTDMA::getSlotLength(int slave)
+{
+	return slaves[slave].slot_us;
+}
+
+unsigned int NRF24L01pTDMA::getResponseCount(int slave)
+{
+	return slaves[slave].responses;
+}
+
+unsigned int NRF24L01pTDMA::getMissCount(int slave)
+{
+	return slaves[slave].misses;
+}
+
+int NRF24L01pTDMA::getSlaveCount(void)
+{
+	return slave_count;
+}
+
+unsigned long NRF24L01pTDMA::getStrayCount(void)
+{
+	return stray_count;
+}
+
+void NRF24L01pTDMA::resetStats(void)
+{
+	int slave = 0;
+	while (slave < slave_count)
+	{
+		TDMA_slave * s = &slaves[slave];
+		s->max_us = 0;
+		int bucket = 0;
+		while (bucket < TDMA_HIST_BUCKETS)
+		{
+			s->hist[bucket] = 0;
+			bucket = bucket+1;
+		}
+		s->responses = 0;
+		s->misses = 0;
+		slave = slave+1;
+	}
+	stray_count = 0;
+}
@@ -0,0 +1,139 @@
+/* nRF24L01p_tdma.h - TDMA polling scheduler for the NRF24L01p library
+	Released to the public domain.
+
+ The master polls every registered slave in turn. Each slave gets a slot:
+ the query is sent, the radio turns around to receive once the query is
+ acknowledged, and the slot ends when the slave answers or the slot length
+ runs out. A query that ends in MAX_RT, or gets neither TX_DS nor MAX_RT
+ within the longest slot, counts as a miss.
+
+ Addresses
+	Slave i listens on its own address (slaves[i].address)
+	Every slave answers to the master address, received on pipe 1
+	Pipe 0 follows TX_ADDR so auto-ACK works for the query
+
+ Responses
+	Byte 0 of every response is the id of the slave that sends it
+	Responses with another id or on another pipe are dropped and counted as strays
+*/
+#ifndef NRF24L01p_tdma_h
+#define NRF24L01p_tdma_h
+
+#include "nRF24L01p.h"
+
+// Latency histogram: bucket i counts responses faster than (TDMA_HIST_BASE_US << i)
+// The last bucket counts everything slower
+#define TDMA_HIST_BUCKETS 8
+#define TDMA_HIST_BASE_US 250
+
+// Slot phases
+#define TDMA_QUERY 0 // Query in the TX FIFO, waiting for TX_DS or MAX_RT
+#define TDMA_LISTEN 1 // Receiving, waiting for the response or the end of the slot
+#define TDMA_WAKE 2 // Registers written again after a chip reset, waiting for power-up
+
+/* TDMA_slave
+	One entry per slave, the table is owned by the sketch so its size is chosen there
+*/
+struct TDMA_slave
+{
+	unsigned char address [5]; // Address the slave listens on
+	unsigned char id; // First byte of every response from this slave
+	unsigned long slot_us; // Current slot length, adapted to the response time
+	unsigned long avg_us; // Smoothed response time
+	unsigned long max_us; // Slowest response seen
+	unsigned int hist [TDMA_HIST_BUCKETS]; // Response time histogram
+	unsigned int responses; // Number of slots the slave answered in
+	unsigned int misses; // Number of slots that ran out without an answer
+};
+
+class NRF24L01pTDMA
+{
+ protected:
+	NRF24L01p * radio;
+	TDMA_slave * slaves; // Slave table supplied by the sketch
+	int max_slaves; // Number of entries in the slave table
+	int slave_count; // Number of registered slaves
+	int addr_width; // The address width to use - 3,4,or 5 bytes
+	int payload_width; // Fixed size of query and response payloads
+	unsigned char query [5]; // Payload sent to every slave at the start of its slot
+	int current; // Slave that owns the current slot, -1 before the first slot
+	int phase; // TDMA_QUERY, TDMA_LISTEN or TDMA_WAKE
+	int next_loaded; // Slave whose address is already in TX_ADDR, -1 if none
+	unsigned long slot_start; // Time the query was acknowledged and the radio turned around (us)
+	unsigned long phase_start; // Time the query was sent or the wake-up started (us)
+	unsigned char master_address [5]; // Address slaves answer to
+	unsigned long stray_count; // Responses dropped because of the wrong id or pipe
+	unsigned long min_slot_us; // Lower bound for adapted slot lengths
+	unsigned long max_slot_us; // Upper bound for adapted slot lengths
+	void (*response_handler)(int slave, unsigned char * data);
+
+ public:
+	/*CONSTRUCTOR
+		@param _radio is the radio used for polling
+		@param slaveTable is storage for up to maxSlaves slaves
+		@param maxSlaves is the number of entries in slaveTable
+	*/
+	NRF24L01pTDMA(NRF24L01p & _radio, TDMA_slave slaveTable [], int maxSlaves);
+
+	/*BEGIN
+	Set up the master address, address width and pipes and power the radio up, call after NRF24L01p.begin
+	@param masterAddr is the address slaves answer to
+	@param addrWidth is the number of address bytes 3-5, written to SETUP_AW
+	@param payloadWidth is the fixed payload width 1-5
+	@param minSlot_us and maxSlot_us bound the adapted slot lengths
+	maxSlot_us is also the deadline for TX_DS or MAX_RT after a query, keep it above the retransmit time (ARC x ARD)
+	After a chip reset only the registers written here are restored, use snapshotRestore for the rest
+	Returns 0 and does nothing if payloadWidth is outside 1-5
+	*/
+	bool begin(unsigned char masterAddr [], int addrWidth, int payloadWidth, unsigned long minSlot_us, unsigned long maxSlot_us);
+
+	/* addSlave Register Slave
+	New slaves start with the longest slot and shrink it as they answer
+	@param address is the address the slave listens on
+	@param id is the first byte of every response from the slave
+	Returns the slave index or -1 if the table is full
+	*/
+	int addSlave(unsigned char address [], unsigned char id);
+
+	/* setQuery Set Query
+	@param DATA is the payload sent at the start of every slot, payloadWidth bytes
+	*/
+	void setQuery(unsigned char DATA []);
+
+	/* setResponseHandler Set Response Handler
+	@param handler is called with the slave index and payload of every response
+	*/
+	void setResponseHandler(void (*handler)(int slave, unsigned char * data));
+
+	/* run Run Scheduler
+	Call from loop as often as possible, never blocks: each call is at most a few SPI transactions
+	The scheduler owns the STATUS register, do not call IRQ_reset_and_respond or clear_interrupts while it runs
+	@param now_us is the current time, usually micros()
+	*/
+	void run(unsigned long now_us);
+
+	/* Slave statistics
+	Latency runs from the query being acknowledged to the response being seen by run
+	getLatencyPercentile returns the upper edge of the histogram bucket holding the percentile (us)
+	@param slave is the slave index returned by addSlave
+	@param percentile is 1-100
+	*/
+	unsigned long getLatencyPercentile(int slave, int percentile);
+	unsigned long getSlotLength(int slave);
+	unsigned int getResponseCount(int slave);
+	unsigned int getMissCount(int slave);
+	int getSlaveCount(void);
+	unsigned long getStrayCount(void);
+	void resetStats(void);
+
+ private:
+	void load_address(int slave);
+	void setup_radio(void);
+	void start_slot(int slave, unsigned long now_us);
+	void end_slot(unsigned long now_us, bool answered);
+	bool read_responses(unsigned long now_us);
+	void record_latency(TDMA_slave * s, unsigned long latency_us);
+
+};
+
+#endif
@@ -0,0 +1,300 @@
+/* nRF24L01p_txqueue.cpp - Priority TX queues for the NRF24L01p library
+	Released to the public domain.
+
+ service() sequence
+	If the chip is powering up after a reset, wait for the power-up delay
+	If a frame is on the air, wait for TX_DS or MAX_RT, requeue the TX FIFO if neither comes in time
+	If a bulk frame would be sent next while an urgent frame waits, flush and requeue the TX FIFO
+	Top up the TX FIFO, urgent frames first
+	Pulse CE for the frame at the head of the TX FIFO
+*/
+
+#include "nRF24L01p_txqueue.h"
+#include "nRF24L01_define_map.h"
+
+NRF24L01pTxQueue::NRF24L01pTxQueue(NRF24L01p & _radio, TXQ_frame urgentBuf [], int urgentDepth, TXQ_frame bulkBuf [], int bulkDepth)
+{
+	radio = &_radio;
+	queues[TXQ_URGENT].frames = urgentBuf;
+	queues[TXQ_URGENT].depth = urgentDepth;
+	queues[TXQ_BULK].frames = bulkBuf;
+	queues[TXQ_BULK].depth = bulkDepth;
+	int ind = 0;
+	while (ind < TXQ_CLASSES)
+	{
+		queues[ind].head = 0;
+		queues[ind].count = 0;
+		ind = ind+1;
+	}
+	hw_count = 0;
+	in_flight = 0;
+	powering_up = 0;
+	tx_timeout_us = 0;
+	resetStats();
+}
+
+
+void NRF24L01pTxQueue::begin(void)
+{
+	// ARD is in steps of 250us, ARC is the number of retransmits
+	unsigned char tmp_retr = *radio->readRegister(SETUP_RETR, 1);
+	unsigned long tmp_ard = 250UL * ((tmp_retr >> ARD) + 1);
+	tx_timeout_us = ((tmp_retr & 0x0F) + 1) * (tmp_ard + TXQ_ATTEMPT_US);
+
+	radio->txModeReady();
+	unsigned char tmp_state [] = {(1<<TX_DS) | (1<<MAX_RT)};
+	radio->writeRegister(STATUS, tmp_state, 1);
+	radio->flushTX();
+	hw_count = 0;
+	in_flight = 0;
+	powering_up = 0;
+}
+
+
+bool NRF24L01pTxQueue::enqueue(int priority, unsigned char DATA [], int BYTE_NUM, unsigned long now_us)
+{
+	if (priority < 0 || priority >= TXQ_CLASSES)
+		return 0;
+	if (BYTE_NUM < 1 || BYTE_NUM > 5)
+		return 0;
+
+	TXQ_ring * q = &queues[priority];
+	if (queued(priority) >= q->depth)
+	{
+		full_count[priority] = full_count[priority]+1;
+		return 0;
+	}
+
+	TXQ_frame * f = &q->frames[(q->head + q->count) % q->depth];
+	int ind = 0;
+	while (ind < BYTE_NUM)
+	{
+		f->data[ind] = DATA[ind];
+		ind = ind+1;
+	}
+	f->width = (unsigned char)ind;
+	f->priority = (unsigned char)priority;
+	f->enqueue_us = now_us;
+	q->count = q->count+1;
+	return 1;
+}
+
+
+void NRF24L01pTxQueue::service(unsigned long now_us)
+{
+	if (powering_up)
+	{
+		if (now_us - wait_start_us < NRF24L01P_POWER_UP_US)
+			return;
+		powering_up = 0;
+	}
+
+	if (in_flight)
+	{
+		unsigned char tmp_status = *radio->readRegister(STATUS, 1);
+		if (CHECK_BIT(tmp_status, TX_DS))
+			complete(now_us, 1);
+		else if (CHECK_BIT(tmp_status, MAX_RT))
+			complete(now_us, 0);
+		else if (now_us - wait_start_us >= tx_timeout_us)
+		{
+			timeout(now_us);
+			if (powering_up)
+				return;
+		}
+		else
+		{
+			// Still on the air, keep the TX FIFO topped up behind it
+			fill_fifo();
+			return;
+		}
+	}
+
+	if (urgent_blocked())
+	{
+		requeue_fifo();
+		preempt_count = preempt_count+1;
+	}
+	fill_fifo();
+
+	if (hw_count > 0)
+	{
+		radio->pulse_ce();
+		in_flight = 1;
+		wait_start_us = now_us;
+	}
+}
+
+
+bool NRF24L01pTxQueue::idle(void)
+{
+	return !in_flight && hw_count == 0 && queues[TXQ_URGENT].count == 0 && queues[TXQ_BULK].count == 0;
+}
+
+
+/* complete Frame Complete
+Clear TX_DS and MAX_RT and retire hw[0]
+On MAX_RT the payload stays at the head of the TX FIFO, so the FIFO is flushed and the rest requeued
+*/
+void NRF24L01pTxQueue::complete(unsigned long now_us, bool sent)
+{
+	unsigned char tmp_state [] = {(1<<TX_DS) | (1<<MAX_RT)};
+	radio->writeRegister(STATUS, tmp_state, 1);
+
+	int priority = hw[0].priority;
+	if (sent)
+	{
+		sent_count[priority] = sent_count[priority]+1;
+		unsigned long tmp_latency = now_us - hw[0].enqueue_us;
+		if (tmp_latency > max_latency_us[priority])
+			max_latency_us[priority] = tmp_latency;
+	}
+	else
+	{
+		failed_count[priority] = failed_count[priority]+1;
+	}
+
+	int ind = 1;
+	while (ind < hw_count)
+	{
+		hw[ind-1] = hw[ind];
+		ind = ind+1;
+	}
+	hw_count = hw_count-1;
+	in_flight = 0;
+
+	if (!sent)
+		requeue_fifo();
+}
+
+
+/* timeout Frame Timeout
+The CE pulse was lost or the chip reset, put the TX FIFO back in the queues to send it again
+A chip that reset is powered down with reset values, so it is powered up before the next pulse
+*/
+void NRF24L01pTxQueue::timeout(unsigned long now_us)
+{
+	timeout_count = timeout_count+1;
+	in_flight = 0;
+	requeue_fifo();
+	if (!radio->snapshotVerify())
+	{
+		radio->txMode();
+		powering_up = 1;
+		wait_start_us = now_us;
+	}
+}
+
+
+/* urgent_blocked Urgent Blocked
+Returns 1 if the next frame out of the TX FIFO is bulk while an urgent frame is waiting
+*/
+bool NRF24L01pTxQueue::urgent_blocked(void)
+{
+	if (hw_count == 0 || hw[0].priority != TXQ_BULK)
+		return 0;
+	return queued(TXQ_URGENT) > 0;
+}
+
+
+/* requeue_fifo Selective Flush
+Flush the TX FIFO and put its frames back at the front of their queues in the original order
+Only called while nothing is on the air
+*/
+void NRF24L01pTxQueue::requeue_fifo(void)
+{
+	radio->flushTX();
+	while (hw_count > 0)
+	{
+		hw_count = hw_count-1;
+		TXQ_ring * q = &queues[hw[hw_count].priority];
+		q->head = (q->head + q->depth - 1) % q->depth;
+		q->frames[q->head] = hw[hw_count];
+		q->count = q->count+1;
+	}
+}
+
+
+/* fill_fifo Fill TX FIFO
+Move frames into the TX FIFO, urgent first, until it is full or the queues are empty
+*/
+void NRF24L01pTxQueue::fill_fifo(void)
+{
+	while (hw_count < TXQ_HW_DEPTH)
+	{
+		TXQ_ring * q = &queues[TXQ_URGENT];
+		if (q->count == 0)
+			q = &queues[TXQ_BULK];
+		if (q->count == 0)
+			return;
+
+		hw[hw_count] = q->frames[q->head];
+		q->head = (q->head+1) % q->depth;
+		q->count = q->count-1;
+		radio->write_payload(W_TX_PAYLOAD, hw[hw_count].data, hw[hw_count].width);
+		hw_count = hw_count+1;
+	}
+}
+
+
+/* queued Frames Queued
+Frames of this class waiting in software or in the TX FIFO
+*/
+int NRF24L01pTxQueue::queued(int priority)
+{
+	int tmp_count = queues[priority].count;
+	int ind = 0;
+	while (ind < hw_count)
+	{
+		if (hw[ind].priority == priority)
+			tmp_count = tmp_count+1;
+		ind = ind+1;
+	}
+	return tmp_count;
+}
+
+
+unsigned long NRF24L01pTxQueue::getSentCount(int priority)
+{
+	return sent_count[priority];
+}
+
+unsigned long NRF24L01pTxQueue::getFailedCount(int priority)
+{
+	return failed_count[priority];
+}
+
+unsigned long NRF24L01pTxQueue::getFullCount(int priority)
+{
+	return full_count[priority];
+}
+
+unsigned long NRF24L01pTxQueue::getMaxLatency(int priority)
+{
+	return max_latency_us[priority];
+}
+
+unsigned int NRF24L01pTxQueue::getPreemptCount(void)
+{
+	return preempt_count;
+}
+
+unsigned int NRF24L01pTxQueue::getTimeoutCount(void)
+{
+	return timeout_count;
+}
+
+void NRF24L01pTxQueue::resetStats(void)
+{
+	int ind = 0;
+	while (ind < TXQ_CLASSES)
+	{
+		sent_count[ind] = 0;
+		failed_count[ind] = 0;
+		full_count[ind] = 0;
+		max_latency_us[ind] = 0;
+		ind = ind+1;
+	}
+	preempt_count = 0;
+	timeout_count = 0;
+}
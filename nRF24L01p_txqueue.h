@@ -0,0 +1,136 @@
+/* nRF24L01p_txqueue.h - Priority TX queues for the NRF24L01p library
+	Released to the public domain.
+
+ Frames are queued in software by priority class and moved into the 3-level
+ hardware TX FIFO by service(). Only one frame is on the air at a time, the
+ others wait in the hardware FIFO so the next one starts without an SPI upload.
+
+ When an urgent frame is queued while bulk frames sit in the hardware FIFO,
+ the FIFO is flushed as soon as the frame on the air is done, the bulk frames
+ go back to the front of their queue and the urgent frame is loaded first.
+
+ Worst-case urgent latency
+	one bulk frame with all retries (ARC x (ARD + airtime))
+	+ the urgent frame itself
+	+ the time between service() calls
+
+ A frame that gets neither TX_DS nor MAX_RT within (ARC+1) x (ARD + TXQ_ATTEMPT_US)
+ goes back to its queue and is sent again. If the chip reset (brownout) it is
+ powered up first, only CONFIG is restored, the sketch restores the rest.
+*/
+#ifndef NRF24L01p_txqueue_h
+#define NRF24L01p_txqueue_h
+
+#include "nRF24L01p.h"
+
+// Priority classes, lower is more urgent
+#define TXQ_URGENT  0
+#define TXQ_BULK    1
+#define TXQ_CLASSES 2
+
+#define TXQ_HW_DEPTH 3 // Depth of the hardware TX FIFO
+#define TXQ_ATTEMPT_US 1000 // Upper bound on one transmission and its ACK, not counting ARD
+
+/* TXQ_frame
+	One queued payload, queue storage is owned by the sketch
+*/
+struct TXQ_frame
+{
+	unsigned char data [5]; // Payload
+	unsigned char width; // Number of payload bytes 1-5
+	unsigned char priority; // TXQ_URGENT or TXQ_BULK
+	unsigned long enqueue_us; // Time the frame was queued
+};
+
+/* TXQ_ring
+	Bounded ring buffer for one priority class
+	Frames of this class waiting in the hardware FIFO also count against depth,
+	so a selective flush can always put them back
+*/
+struct TXQ_ring
+{
+	TXQ_frame * frames;
+	int depth;
+	int head;
+	int count;
+};
+
+class NRF24L01pTxQueue
+{
+ protected:
+	NRF24L01p * radio;
+	TXQ_ring queues [TXQ_CLASSES];
+	TXQ_frame hw [TXQ_HW_DEPTH]; // Copy of the hardware TX FIFO, hw[0] is sent first
+	int hw_count; // Number of frames in the hardware TX FIFO
+	bool in_flight; // Set while hw[0] is on the air
+	bool powering_up; // Set while the chip powers up again after a reset
+	unsigned long wait_start_us; // Time of the CE pulse, or of the power-up
+	unsigned long tx_timeout_us; // Longest TX_DS or MAX_RT can take, from SETUP_RETR
+
+	unsigned long sent_count [TXQ_CLASSES]; // Frames acknowledged
+	unsigned long failed_count [TXQ_CLASSES]; // Frames dropped after MAX_RT
+	unsigned long full_count [TXQ_CLASSES]; // Frames refused because the queue was full
+	unsigned long max_latency_us [TXQ_CLASSES]; // Worst enqueue to TX_DS time
+	unsigned int preempt_count; // Number of selective flushes
+	unsigned int timeout_count; // Frames that got neither TX_DS nor MAX_RT
+
+ public:
+	/*CONSTRUCTOR
+		@param _radio is the radio frames are sent on
+		@param urgentBuf and urgentDepth are storage for the urgent queue
+		@param bulkBuf and bulkDepth are storage for the bulk queue
+	*/
+	NRF24L01pTxQueue(NRF24L01p & _radio, TXQ_frame urgentBuf [], int urgentDepth, TXQ_frame bulkBuf [], int bulkDepth);
+
+	/*BEGIN
+	Put the radio into transmit mode with an empty TX FIFO, call after TX_ADDR and SETUP_RETR are set
+	Waits out the power-up delay if the radio was powered down
+	The queue owns the TX FIFO and the TX_DS and MAX_RT flags from here on,
+	do not call txData, flushTX or clear_interrupts while it is in use
+	*/
+	void begin(void);
+
+	/* enqueue Queue Frame
+	@param priority is TXQ_URGENT or TXQ_BULK
+	@param DATA is the data to transmit
+	@param BYTE_NUM is the number of bytes to transmit 1-5
+	@param now_us is the current time, usually micros()
+	Returns 0 if priority is not a class (0 to TXQ_CLASSES-1), BYTE_NUM is outside 1-5
+	or the queue for this class is full
+	*/
+	bool enqueue(int priority, unsigned char DATA [], int BYTE_NUM, unsigned long now_us);
+
+	/* service Service Queues
+	Call from loop as often as possible, never blocks
+	@param now_us is the current time, usually micros()
+	*/
+	void service(unsigned long now_us);
+
+	/* idle Queues Idle
+	Returns 1 when nothing is queued or on the air
+	*/
+	bool idle(void);
+
+	/* Statistics per priority class
+	getMaxLatency is the worst time from enqueue to TX_DS (us)
+	getTimeoutCount is the number of frames sent again after neither TX_DS nor MAX_RT came
+	*/
+	unsigned long getSentCount(int priority);
+	unsigned long getFailedCount(int priority);
+	unsigned long getFullCount(int priority);
+	unsigned long getMaxLatency(int priority);
+	unsigned int getPreemptCount(void);
+	unsigned int getTimeoutCount(void);
+	void resetStats(void);
+
+ private:
+	void requeue_fifo(void);
+	bool urgent_blocked(void);
+	void fill_fifo(void);
+	void complete(unsigned long now_us, bool sent);
+	void timeout(unsigned long now_us);
+	int queued(int priority);
+
+};
+
+#endif
@@ -0,0 +1,190 @@
+/* beacon_test.cpp - Beacon with TX payload reuse against uploading every cycle
+	Released to the public domain.
+
+ SPI bytes and CPU time per beacon for
+	txData      txData + clear_interrupts, the current approach
+	noack       txDataNoAck + clear_interrupts
+	reuse       beaconLoad (content unchanged) + beaconSend
+ One receiver listens on the beacon address and counts what arrives.
+*/
+
+#include "nRF24L01p.h"
+#include "nRF24L01_define_map.h"
+#include "fake_radio.h"
+#include "expect.h"
+
+#define BEACONS 200
+
+fake::Radio txChip(9, 10);
+fake::Radio rxChip(7, 8);
+NRF24L01p txRadio(9, 10);
+NRF24L01p rxRadio(7, 8);
+
+const int beaconWidth = 3;
+unsigned char beaconAddr [] = {0xC3,0xC3,0xC3};
+unsigned char beaconData [] = {0x10, 0x64, 0x00};
+
+enum {MODE_TXDATA, MODE_NOACK, MODE_REUSE};
+
+struct Result
+{
+	double spi_bytes;
+	double cpu_us;
+	unsigned long received;
+	unsigned long irq_asserted; // Beacons after which the IRQ pin was low
+};
+
+static bool irq_asserted(void)
+{
+	// IRQ is active when a flag in STATUS is set and not masked in CONFIG
+	unsigned char tmp_flags = txChip.reg(STATUS) & 0x70;
+	unsigned char tmp_mask = txChip.reg(CONFIG) & 0x70;
+	return (tmp_flags & ~tmp_mask) != 0;
+}
+
+static unsigned long drain_receiver(void)
+{
+	unsigned long tmp_count = 0;
+	while (!(*rxRadio.readRegister(FIFO_STATUS, 1) & (1<<RX_EMPTY)))
+	{
+		rxRadio.rData(beaconWidth);
+		tmp_count = tmp_count+1;
+	}
+	return tmp_count;
+}
+
+static Result run(int mode)
+{
+	fake::reset();
+	rxRadio.begin();
+	unsigned char pipesOn [] = {0x01};
+	rxRadio.setup_data_pipes(pipesOn, beaconWidth);
+	rxRadio.writeRegister(RX_ADDR_P0, beaconAddr, 3);
+	// 3-byte addresses, beaconBegin sets the transmitter to the same width
+	unsigned char awArg [] = {0x01};
+	rxRadio.writeRegister(SETUP_AW, awArg, 1);
+	rxRadio.rMode();
+
+	txRadio.begin();
+	if (mode == MODE_REUSE)
+	{
+		txRadio.beaconBegin(beaconAddr, 3);
+		txRadio.beaconLoad(beaconData, beaconWidth);
+	}
+	else
+	{
+		txRadio.enable_dynamic_ack(1);
+		txRadio.writeRegister(TX_ADDR, beaconAddr, 3);
+		txRadio.writeRegister(RX_ADDR_P0, beaconAddr, 3);
+		txRadio.writeRegister(SETUP_AW, awArg, 1);
+		txRadio.txMode();
+	}
+	fake::advance(2000);
+
+	Result res = {0, 0, 0, 0};
+	for (int n=0; n<BEACONS; n++)
+	{
+		unsigned long tmp_bytes = txChip.spi_bytes;
+		unsigned long tmp_time = fake::now_us;
+		if (mode == MODE_TXDATA)
+		{
+			txRadio.txData(beaconData, beaconWidth);
+			txRadio.clear_interrupts();
+		}
+		else if (mode == MODE_NOACK)
+		{
+			txRadio.txDataNoAck(beaconData, beaconWidth);
+			txRadio.clear_interrupts();
+		}
+		else
+		{
+			txRadio.beaconLoad(beaconData, beaconWidth);
+			txRadio.beaconSend();
+		}
+		res.spi_bytes += txChip.spi_bytes - tmp_bytes;
+		res.cpu_us += fake::now_us - tmp_time;
+
+		// Beacon period
+		fake::advance(10000);
+		if (irq_asserted())
+			res.irq_asserted = res.irq_asserted+1;
+		res.received += drain_receiver();
+	}
+	res.spi_bytes /= BEACONS;
+	res.cpu_us /= BEACONS;
+	return res;
+}
+
+int main(void)
+{
+	Result txdata = run(MODE_TXDATA);
+	Result noack = run(MODE_NOACK);
+	Result reuse = run(MODE_REUSE);
+
+	printf("beacon_test: %d beacons of %d bytes\n", BEACONS, beaconWidth);
+	printf("  txData   %5.1f SPI bytes %7.1f us per beacon\n", txdata.spi_bytes, txdata.cpu_us);
+	printf("  noack    %5.1f SPI bytes %7.1f us per beacon\n", noack.spi_bytes, noack.cpu_us);
+	printf("  reuse    %5.1f SPI bytes %7.1f us per beacon\n", reuse.spi_bytes, reuse.cpu_us);
+
+	// Every approach gets every beacon on the air
+	EXPECT(txdata.received == BEACONS);
+	EXPECT(noack.received == BEACONS);
+	EXPECT(reuse.received == BEACONS);
+
+	// Payload upload, then 3 STATUS writes and FLUSH_TX for the current approach
+	EXPECT(txdata.spi_bytes == 1 + beaconWidth + 7);
+	// Reuse sends nothing over SPI and only holds CE for the pulse
+	EXPECT(reuse.spi_bytes == 0);
+	EXPECT(reuse.cpu_us < 20);
+	EXPECT(txdata.cpu_us > 1000);
+	// TX_DS is masked in beacon mode, so the IRQ pin stays inactive between beacons
+	EXPECT(reuse.irq_asserted == 0);
+	// beaconBegin set the 3-byte address width the receiver uses
+	EXPECT(txChip.reg(SETUP_AW) == 0x01);
+
+	// A content change costs the payload plus FLUSH_TX, REUSE_TX_PL and the TX_DS clear
+	// The last beacon went out a beacon period ago, so there is no airtime left to wait for
+	unsigned long tmp_bytes = txChip.spi_bytes;
+	unsigned long tmp_time = fake::now_us;
+	beaconData[1] = 0x63;
+	EXPECT(txRadio.beaconLoad(beaconData, beaconWidth));
+	unsigned long changeUs = fake::now_us - tmp_time;
+	printf("  reuse content change %lu SPI bytes %lu us\n", txChip.spi_bytes - tmp_bytes, changeUs);
+	EXPECT(txChip.spi_bytes - tmp_bytes == (unsigned long)beaconWidth + 5);
+	EXPECT(changeUs < 100);
+	EXPECT(txRadio.beaconActive());
+	txRadio.beaconSend();
+	fake::advance(10000);
+	EXPECT(drain_receiver() == 1);
+
+	// Right after a beacon, the load waits for the rest of its airtime and no more
+	txRadio.beaconSend();
+	tmp_time = fake::now_us;
+	beaconData[1] = 0x62;
+	EXPECT(txRadio.beaconLoad(beaconData, beaconWidth));
+	changeUs = fake::now_us - tmp_time;
+	printf("  reuse content change right after a beacon %lu us\n", changeUs);
+	EXPECT(changeUs >= NRF24L01P_BEACON_AIRTIME_US - 20 && changeUs < NRF24L01P_BEACON_AIRTIME_US + 100);
+	txRadio.beaconSend();
+	fake::advance(10000);
+	// Both the old and the new content got on the air
+	EXPECT(drain_receiver() == 2);
+	EXPECT(txChip.tx_aborts == 0);
+
+	// Payload widths outside 1-5 are refused and the loaded beacon is kept
+	unsigned char tmpLong [] = {1, 2, 3, 4, 5, 6};
+	tmp_bytes = txChip.spi_bytes;
+	EXPECT(!txRadio.beaconLoad(tmpLong, 6));
+	EXPECT(!txRadio.beaconLoad(tmpLong, 0));
+	EXPECT(txChip.spi_bytes == tmp_bytes);
+
+	// A flush ends reuse and beaconLoad uploads the same content again
+	txRadio.flushTX();
+	EXPECT(!txRadio.beaconActive());
+	tmp_bytes = txChip.spi_bytes;
+	txRadio.beaconLoad(beaconData, beaconWidth);
+	EXPECT(txChip.spi_bytes - tmp_bytes == (unsigned long)beaconWidth + 5);
+	EXPECT(txChip.pwrup_violations == 0);
+
+	return EXPECT_DONE("beacon_test");
+}
@@ -0,0 +1,43 @@
+/* SPI.h - Arduino and SPI stubs for host tests of the NRF24L01p library
+	Released to the public domain.
+
+ Pins and SPI transfers are routed to the fake::Radio selected by its pins,
+ time is the simulated clock in fake_radio.cpp.
+*/
+#ifndef fake_SPI_h
+#define fake_SPI_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define SPI_CLOCK_DIV8 8
+
+typedef bool boolean;
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int val);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long micros(void);
+unsigned long millis(void);
+
+class SPIClass
+{
+ public:
+	void begin(void) {}
+	void setBitOrder(int) {}
+	void setDataMode(int) {}
+	void setClockDivider(int) {}
+	unsigned char transfer(unsigned char val);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,52 @@
+/* arduino.cpp - Arduino and SPI stubs for host tests of the NRF24L01p library
+	Released to the public domain.
+*/
+
+#include "SPI.h"
+#include "fake_radio.h"
+
+SPIClass SPI;
+
+void pinMode(int, int)
+{
+}
+
+void digitalWrite(int pin, int val)
+{
+	fake::Radio * tmp_radio = fake::radio_by_pin(pin);
+	if (!tmp_radio)
+		return;
+	if (pin == tmp_radio->ce_pin)
+		tmp_radio->set_ce(val);
+	else
+		tmp_radio->set_csn(val);
+}
+
+void delay(unsigned long ms)
+{
+	fake::advance(ms*1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	fake::advance(us);
+}
+
+unsigned long micros(void)
+{
+	return fake::now_us;
+}
+
+unsigned long millis(void)
+{
+	return fake::now_us/1000;
+}
+
+unsigned char SPIClass::transfer(unsigned char val)
+{
+	fake::advance(fake::spi_byte_us);
+	fake::Radio * tmp_radio = fake::selected_radio();
+	if (!tmp_radio)
+		return 0;
+	return tmp_radio->transfer(val);
+}
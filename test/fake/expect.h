@@ -0,0 +1,18 @@
+/* expect.h - Minimal checks for host tests of the NRF24L01p library
+	Released to the public domain.
+*/
+#ifndef fake_expect_h
+#define fake_expect_h
+
+#include <stdio.h>
+
+extern int expect_failures;
+
+#define EXPECT(cond) \
+	do { if (!(cond)) { printf("%s:%d: FAILED: %s\n", __FILE__, __LINE__, #cond); expect_failures++; } } while (0)
+
+// Print the result and return the exit code from main
+#define EXPECT_DONE(name) \
+	(printf("%s: %s\n", name, expect_failures ? "FAILED" : "passed"), expect_failures ? 1 : 0)
+
+#endif
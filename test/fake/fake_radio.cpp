@@ -0,0 +1,556 @@
+/* fake_radio.cpp - Host model of the nRF24L01+ for the NRF24L01p library tests
+	Released to the public domain.
+*/
+
+#include "fake_radio.h"
+#include "nRF24L01_define_map.h"
+#include <string.h>
+#include <algorithm>
+
+namespace fake
+{
+
+Air air = {0.0, 1, 0};
+unsigned long now_us = 0;
+unsigned long spi_byte_us = 4;
+
+// Radios are often globals in other files, so the list is built on first use
+static std::vector<Radio *> & radio_list(void)
+{
+	static std::vector<Radio *> tmp_list;
+	return tmp_list;
+}
+
+struct Injection
+{
+	unsigned long at_us;
+	Packet p;
+};
+static std::vector<Injection> injections;
+
+// Settling time from standby to TX or RX
+#define SETTLE_US 130
+// Power down to standby with the crystal running
+#define PWRUP_US 1500
+#define NO_EVENT 0xFFFFFFFFUL
+
+double random01(void)
+{
+	// 31-bit LCG, enough for loss and jitter
+	air.seed = (air.seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return (double)air.seed / 2147483648.0;
+}
+
+
+Radio::Radio(int cePin, int csnPin)
+{
+	ce_pin = cePin;
+	csn_pin = csnPin;
+	radio_list().push_back(this);
+	power_on_reset();
+}
+
+Radio::~Radio()
+{
+	radio_list().erase(std::find(radio_list().begin(), radio_list().end(), this));
+}
+
+void Radio::power_on_reset(void)
+{
+	static const unsigned char defaults [0x20] = {
+		0x08, 0x3F, 0x03, 0x03, 0x03, 0x02, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC3, 0xC4, 0xC5, 0xC6,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	memcpy(regs, defaults, sizeof(regs));
+	memset(addrs[0], 0xE7, 5);
+	memset(addrs[1], 0xC2, 5);
+	memset(addrs[2], 0xE7, 5);
+	ce = 0;
+	csn = 1;
+	reuse = 0;
+	ready_us = 0;
+	cur.clear();
+	tx_fifo.clear();
+	rx_fifo.clear();
+	tx_phase = TX_IDLE;
+	tx_event_us = NO_EVENT;
+	tx_retries = 0;
+	tx_acked = 0;
+	tx_run = 0;
+	tx_run_start = 0;
+
+	spi_bytes = 0;
+	packets_sent = 0;
+	packets_failed = 0;
+	transmissions = 0;
+	max_tx_run_us = 0;
+	pwrup_violations = 0;
+	tx_aborts = 0;
+	tx_overflows = 0;
+	logging = 0;
+	log.clear();
+}
+
+
+unsigned char Radio::reg(unsigned char thisRegister)
+{
+	return read_reg(thisRegister, 0);
+}
+
+const unsigned char * Radio::address(unsigned char thisRegister)
+{
+	if (thisRegister == RX_ADDR_P0)
+		return addrs[0];
+	if (thisRegister == RX_ADDR_P1)
+		return addrs[1];
+	return addrs[2];
+}
+
+int Radio::addr_width(void)
+{
+	return (regs[SETUP_AW] & 0x03) + 2;
+}
+
+unsigned long Radio::airtime_us(int payloadWidth)
+{
+	int crc = 0;
+	if (regs[CONFIG] & (1<<EN_CRC))
+		crc = (regs[CONFIG] & (1<<CRCO)) ? 2 : 1;
+	// Preamble, address, 9-bit packet control field, payload, CRC
+	unsigned long bits = 8*(1 + addr_width() + payloadWidth + crc) + 9;
+	unsigned long kbps = 1000;
+	if (regs[RF_SETUP] & (1<<RF_DR_LOW))
+		kbps = 250;
+	else if (regs[RF_SETUP] & (1<<RF_DR_HIGH))
+		kbps = 2000;
+	return (bits*1000 + kbps - 1) / kbps;
+}
+
+bool Radio::powered_rx(void)
+{
+	return (regs[CONFIG] & (1<<PWR_UP)) && (regs[CONFIG] & (1<<PRIM_RX)) && ce;
+}
+
+
+unsigned char Radio::status(void)
+{
+	unsigned char tmp_status = regs[STATUS] & 0x70;
+	if (rx_fifo.empty())
+		tmp_status |= 0x0E;
+	else
+		tmp_status |= rx_fifo.front().pipe << 1;
+	if (tx_fifo.size() >= 3)
+		tmp_status |= 1<<TX_FULL;
+	return tmp_status;
+}
+
+unsigned char Radio::fifo_status(void)
+{
+	unsigned char tmp_status = 0;
+	if (reuse)
+		tmp_status |= 1<<TX_REUSE;
+	if (tx_fifo.size() >= 3)
+		tmp_status |= 1<<FIFO_FULL;
+	if (tx_fifo.empty())
+		tmp_status |= 1<<TX_EMPTY;
+	if (rx_fifo.size() >= 3)
+		tmp_status |= 1<<RX_FULL;
+	if (rx_fifo.empty())
+		tmp_status |= 1<<RX_EMPTY;
+	return tmp_status;
+}
+
+unsigned char Radio::read_reg(unsigned char thisRegister, int ind)
+{
+	if (thisRegister == STATUS)
+		return ind == 0 ? status() : 0;
+	if (thisRegister == FIFO_STATUS)
+		return ind == 0 ? fifo_status() : 0;
+	if (thisRegister == RX_ADDR_P0 || thisRegister == RX_ADDR_P1 || thisRegister == TX_ADDR)
+		return ind < addr_width() ? address(thisRegister)[ind] : 0;
+	return ind == 0 ? regs[thisRegister] : 0;
+}
+
+void Radio::write_reg(unsigned char thisRegister, const unsigned char * val, int byteNum)
+{
+	if (thisRegister == STATUS)
+	{
+		// Interrupt flags are cleared by writing 1
+		regs[STATUS] &= ~(val[0] & 0x70);
+		try_start();
+		return;
+	}
+	if (thisRegister == FIFO_STATUS || thisRegister == OBSERVE_TX || thisRegister == RPD)
+		return;
+	if (thisRegister == RX_ADDR_P0 || thisRegister == RX_ADDR_P1 || thisRegister == TX_ADDR)
+	{
+		memcpy((unsigned char *)address(thisRegister), val, std::min(byteNum, 5));
+		return;
+	}
+	if (thisRegister == CONFIG)
+	{
+		unsigned char tmp_old = regs[CONFIG];
+		regs[CONFIG] = val[0];
+		if (!(tmp_old & (1<<PWR_UP)) && (val[0] & (1<<PWR_UP)))
+			ready_us = now_us + PWRUP_US;
+		if (tx_phase != TX_IDLE && ((val[0] & (1<<PRIM_RX)) || !(val[0] & (1<<PWR_UP))))
+		{
+			tx_aborts = tx_aborts+1;
+			tx_phase = TX_IDLE;
+			tx_event_us = NO_EVENT;
+			end_run(now_us);
+		}
+		try_start();
+		return;
+	}
+	regs[thisRegister] = val[0];
+}
+
+
+void Radio::set_ce(bool val)
+{
+	ce = val;
+	if (ce)
+		try_start();
+}
+
+bool Radio::selected(void)
+{
+	return !csn;
+}
+
+void Radio::set_csn(bool val)
+{
+	if (csn && !val)
+		cur.clear();
+	if (!csn && val && !cur.empty())
+		end_transaction();
+	csn = val;
+}
+
+unsigned char Radio::transfer(unsigned char val)
+{
+	spi_bytes = spi_bytes+1;
+	int ind = cur.size();
+	cur.push_back(val);
+	if (ind == 0)
+		return status();
+
+	unsigned char cmd = cur[0];
+	if (cmd <= (R_REGISTER | REGISTER_MASK))
+		return read_reg(cmd & REGISTER_MASK, ind-1);
+	if (cmd == R_RX_PAYLOAD && !rx_fifo.empty() && ind-1 < rx_fifo.front().width)
+		return rx_fifo.front().data[ind-1];
+	return 0;
+}
+
+void Radio::end_transaction(void)
+{
+	if (logging)
+	{
+		Transaction t;
+		t.time_us = now_us;
+		t.bytes = cur;
+		log.push_back(t);
+	}
+
+	unsigned char cmd = cur[0];
+	int byteNum = cur.size()-1;
+	if (cmd >= W_REGISTER && cmd <= (W_REGISTER | REGISTER_MASK))
+	{
+		if (byteNum > 0)
+			write_reg(cmd & REGISTER_MASK, &cur[1], byteNum);
+	}
+	else if (cmd == R_RX_PAYLOAD)
+	{
+		if (!rx_fifo.empty())
+			rx_fifo.pop_front();
+	}
+	else if (cmd == W_TX_PAYLOAD || cmd == W_TX_PAYLOAD_NO_ACK)
+	{
+		reuse = 0;
+		if (tx_fifo.size() >= 3)
+		{
+			tx_overflows = tx_overflows+1;
+			return;
+		}
+		Packet p;
+		memset(&p, 0, sizeof(p));
+		memcpy(p.data, &cur[1], std::min(byteNum, 32));
+		p.width = byteNum;
+		p.no_ack = cmd == W_TX_PAYLOAD_NO_ACK && (regs[FEATURE] & (1<<EN_DYN_ACK));
+		tx_fifo.push_back(p);
+		try_start();
+	}
+	else if (cmd == FLUSH_TX)
+	{
+		tx_fifo.clear();
+		reuse = 0;
+	}
+	else if (cmd == FLUSH_RX)
+	{
+		rx_fifo.clear();
+	}
+	else if (cmd == REUSE_TX_PL)
+	{
+		reuse = 1;
+	}
+}
+
+
+/* try_start
+Standby-I with a CE edge or Standby-II with a new payload: start the packet at the head of the TX FIFO
+*/
+void Radio::try_start(void)
+{
+	if (tx_phase != TX_IDLE || !ce || tx_fifo.empty())
+		return;
+	if (!(regs[CONFIG] & (1<<PWR_UP)) || (regs[CONFIG] & (1<<PRIM_RX)))
+		return;
+	if (regs[STATUS] & (1<<MAX_RT))
+		return;
+
+	unsigned long tmp_start = now_us;
+	if (now_us < ready_us)
+	{
+		pwrup_violations = pwrup_violations+1;
+		tmp_start = ready_us;
+	}
+	start_packet(tmp_start, 1);
+}
+
+void Radio::start_packet(unsigned long at_us, bool settle)
+{
+	if (!tx_run)
+	{
+		tx_run = 1;
+		tx_run_start = at_us;
+	}
+	tx_cur = tx_fifo.front();
+	tx_cur.addr_width = addr_width();
+	memcpy(tx_cur.addr, addrs[2], 5);
+	tx_retries = 0;
+	tx_phase = TX_AIR;
+	tx_event_us = at_us + (settle ? SETTLE_US : 0) + airtime_us(tx_cur.width);
+}
+
+void Radio::end_run(unsigned long at_us)
+{
+	if (!tx_run)
+		return;
+	if (at_us - tx_run_start > max_tx_run_us)
+		max_tx_run_us = at_us - tx_run_start;
+	tx_run = 0;
+}
+
+void Radio::finish_packet(bool sent)
+{
+	tx_phase = TX_IDLE;
+	tx_event_us = NO_EVENT;
+	if (sent)
+	{
+		regs[STATUS] |= 1<<TX_DS;
+		if (!reuse && !tx_fifo.empty())
+			tx_fifo.pop_front();
+		packets_sent = packets_sent+1;
+		// CE still high and more to send: next packet without going back to standby
+		if (ce && !tx_fifo.empty())
+		{
+			start_packet(now_us, 0);
+			return;
+		}
+	}
+	else
+	{
+		regs[STATUS] |= 1<<MAX_RT;
+		packets_failed = packets_failed+1;
+	}
+	end_run(now_us);
+}
+
+unsigned long Radio::next_event(void)
+{
+	return tx_event_us;
+}
+
+void Radio::run_event(void)
+{
+	if (tx_phase == TX_AIR)
+	{
+		transmissions = transmissions+1;
+		int acks = 0;
+		for (size_t ind = 0; ind < radio_list().size(); ind++)
+		{
+			if (radio_list()[ind] != this)
+				radio_list()[ind]->receive(tx_cur, acks);
+		}
+		if (air.virtual_node)
+			acks = acks + air.virtual_node(tx_cur);
+
+		bool tmp_expect_ack = !tx_cur.no_ack && (regs[EN_AA] & (1<<ENAA_P0));
+		if (!tmp_expect_ack)
+		{
+			finish_packet(1);
+			return;
+		}
+		// More than one ACK on the air collides
+		tx_acked = acks == 1 && random01() >= air.loss;
+		tx_phase = TX_ACK_WAIT;
+		if (tx_acked)
+			tx_event_us = now_us + SETTLE_US + airtime_us(0);
+		else
+			tx_event_us = now_us + 250*(((regs[SETUP_RETR] >> ARD) & 0x0F) + 1);
+		return;
+	}
+
+	if (tx_phase == TX_ACK_WAIT)
+	{
+		if (tx_acked)
+		{
+			finish_packet(1);
+			return;
+		}
+		tx_retries = tx_retries+1;
+		if (tx_retries > (regs[SETUP_RETR] & 0x0F))
+		{
+			finish_packet(0);
+			return;
+		}
+		tx_phase = TX_AIR;
+		tx_event_us = now_us + SETTLE_US + airtime_us(tx_cur.width);
+	}
+}
+
+void Radio::receive(const Packet & p, int & acks)
+{
+	if (!powered_rx() || now_us < ready_us)
+		return;
+	int tmp_width = addr_width();
+	if (p.addr_width != tmp_width)
+		return;
+
+	int pipe = 0;
+	while (pipe < 6)
+	{
+		if (regs[EN_RXADDR] & (1<<pipe))
+		{
+			unsigned char tmp_addr [5];
+			if (pipe == 0)
+				memcpy(tmp_addr, addrs[0], 5);
+			else
+			{
+				// Pipes 2-5 share the upper bytes of pipe 1
+				memcpy(tmp_addr, addrs[1], 5);
+				if (pipe > 1)
+					tmp_addr[0] = regs[RX_ADDR_P2 + pipe-2];
+			}
+			if (memcmp(tmp_addr, p.addr, tmp_width) == 0)
+				break;
+		}
+		pipe = pipe+1;
+	}
+	if (pipe == 6)
+		return;
+	if (random01() < air.loss)
+		return;
+	if (p.width != regs[RX_PW_P0 + pipe] || rx_fifo.size() >= 3)
+		return;
+
+	Packet tmp_p = p;
+	tmp_p.pipe = pipe;
+	rx_fifo.push_back(tmp_p);
+	regs[STATUS] |= 1<<RX_DR;
+	if ((regs[EN_AA] & (1<<pipe)) && !p.no_ack)
+		acks = acks+1;
+}
+
+
+void reset(void)
+{
+	now_us = 0;
+	spi_byte_us = 4;
+	air.loss = 0.0;
+	air.seed = 1;
+	air.virtual_node = 0;
+	injections.clear();
+	for (size_t ind = 0; ind < radio_list().size(); ind++)
+		radio_list()[ind]->power_on_reset();
+}
+
+Radio * radio_by_pin(int pin)
+{
+	for (size_t ind = 0; ind < radio_list().size(); ind++)
+	{
+		if (radio_list()[ind]->ce_pin == pin || radio_list()[ind]->csn_pin == pin)
+			return radio_list()[ind];
+	}
+	return 0;
+}
+
+Radio * selected_radio(void)
+{
+	for (size_t ind = 0; ind < radio_list().size(); ind++)
+	{
+		if (radio_list()[ind]->selected())
+			return radio_list()[ind];
+	}
+	return 0;
+}
+
+void inject(unsigned long at_us, const unsigned char addr [], int addrWidth, const unsigned char data [], int width)
+{
+	Injection tmp_inj;
+	memset(&tmp_inj, 0, sizeof(tmp_inj));
+	tmp_inj.at_us = at_us;
+	memcpy(tmp_inj.p.addr, addr, addrWidth);
+	tmp_inj.p.addr_width = addrWidth;
+	memcpy(tmp_inj.p.data, data, width);
+	tmp_inj.p.width = width;
+	injections.push_back(tmp_inj);
+}
+
+void advance(unsigned long us)
+{
+	unsigned long tmp_end = now_us + us;
+	while (1)
+	{
+		// Earliest pending event: a radio's TX state machine or an injected packet
+		unsigned long tmp_next = NO_EVENT;
+		Radio * tmp_radio = 0;
+		int tmp_inj = -1;
+		for (size_t ind = 0; ind < radio_list().size(); ind++)
+		{
+			if (radio_list()[ind]->next_event() < tmp_next)
+			{
+				tmp_next = radio_list()[ind]->next_event();
+				tmp_radio = radio_list()[ind];
+			}
+		}
+		for (size_t ind = 0; ind < injections.size(); ind++)
+		{
+			if (injections[ind].at_us < tmp_next)
+			{
+				tmp_next = injections[ind].at_us;
+				tmp_radio = 0;
+				tmp_inj = ind;
+			}
+		}
+		if (tmp_next > tmp_end)
+			break;
+
+		if (tmp_next > now_us)
+			now_us = tmp_next;
+		if (tmp_radio)
+			tmp_radio->run_event();
+		else
+		{
+			Packet tmp_p = injections[tmp_inj].p;
+			injections.erase(injections.begin() + tmp_inj);
+			int acks = 0;
+			for (size_t ind = 0; ind < radio_list().size(); ind++)
+				radio_list()[ind]->receive(tmp_p, acks);
+		}
+	}
+	now_us = tmp_end;
+}
+
+}
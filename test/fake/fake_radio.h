@@ -0,0 +1,151 @@
+/* fake_radio.h - Host model of the nRF24L01+ for the NRF24L01p library tests
+	Released to the public domain.
+
+ Every fake::Radio sits on one shared SPI bus and is selected by its CSN pin,
+ so several NRF24L01p objects can talk to each other through fake::air.
+
+ Modelled
+	Register file with power-on reset values, STATUS and FIFO_STATUS
+	3-level TX and RX FIFOs, W_TX_PAYLOAD_NO_ACK, REUSE_TX_PL, FLUSH_TX/RX
+	PTX: 130us settling, airtime from RF_SETUP, auto-ACK, ARD/ARC retransmits, MAX_RT
+	PRX: address match on enabled pipes, static payload width, auto-ACK
+	1.5ms power down to standby, 4us per SPI byte
+
+ Checked
+	Continuous time in TX mode (spec 6.1.5 limits it to 4ms)
+	Transmissions started before the 1.5ms power-up delay
+	PRIM_RX or PWR_UP changed while a packet is in progress
+*/
+#ifndef fake_radio_h
+#define fake_radio_h
+
+#include <deque>
+#include <vector>
+
+namespace fake
+{
+
+struct Packet
+{
+	unsigned char addr [5];
+	int addr_width;
+	unsigned char data [32];
+	int width;
+	bool no_ack; // NO_ACK flag on the air (W_TX_PAYLOAD_NO_ACK with EN_DYN_ACK)
+	int pipe; // Pipe the packet was received on
+};
+
+/* One SPI transaction (CSN low to CSN high), bytes sent by the MCU */
+struct Transaction
+{
+	unsigned long time_us;
+	std::vector<unsigned char> bytes;
+};
+
+class Radio
+{
+ public:
+	Radio(int cePin, int csnPin);
+	~Radio();
+
+	void power_on_reset(void);
+
+	// Pin and bus interface, called from the Arduino stubs
+	void set_ce(bool val);
+	void set_csn(bool val);
+	unsigned char transfer(unsigned char val);
+	bool selected(void);
+
+	// Register view for tests
+	unsigned char reg(unsigned char thisRegister);
+	const unsigned char * address(unsigned char thisRegister);
+
+	// Called by the scheduler in fake::advance
+	unsigned long next_event(void);
+	void run_event(void);
+	void receive(const Packet & p, int & acks);
+
+	int ce_pin;
+	int csn_pin;
+
+	std::deque<Packet> tx_fifo;
+	std::deque<Packet> rx_fifo;
+
+	// Statistics, cleared by power_on_reset
+	unsigned long spi_bytes; // Bytes clocked over SPI
+	unsigned long packets_sent; // Packets completed with TX_DS
+	unsigned long packets_failed; // Packets that ended in MAX_RT
+	unsigned long transmissions; // Packets put on the air, retransmits included
+	unsigned long max_tx_run_us; // Longest continuous time in TX mode
+	unsigned long pwrup_violations; // Transmissions started before the 1.5ms power-up delay
+	unsigned long tx_aborts; // PRIM_RX or PWR_UP changed while a packet was in progress
+	unsigned long tx_overflows; // Payloads written to a full TX FIFO
+	bool logging; // Record every transaction in log
+	std::vector<Transaction> log;
+
+ private:
+	unsigned char regs [0x20];
+	unsigned char addrs [3][5]; // RX_ADDR_P0, RX_ADDR_P1, TX_ADDR
+	bool ce;
+	bool csn;
+	bool reuse;
+	unsigned long ready_us; // Time the chip reaches standby after PWR_UP
+
+	std::vector<unsigned char> cur; // Bytes of the transaction in progress
+
+	enum {TX_IDLE, TX_AIR, TX_ACK_WAIT} tx_phase;
+	Packet tx_cur; // Packet on the air, addressed with TX_ADDR when it started
+	unsigned long tx_event_us;
+	int tx_retries;
+	bool tx_acked;
+	bool tx_run;
+	unsigned long tx_run_start;
+
+	unsigned char status(void);
+	unsigned char fifo_status(void);
+	unsigned char read_reg(unsigned char thisRegister, int ind);
+	void write_reg(unsigned char thisRegister, const unsigned char * val, int byteNum);
+	void end_transaction(void);
+	void try_start(void);
+	void start_packet(unsigned long at_us, bool settle);
+	void finish_packet(bool sent);
+	void end_run(unsigned long at_us);
+	int addr_width(void);
+	unsigned long airtime_us(int payloadWidth);
+	bool powered_rx(void);
+};
+
+/* Shared air and clock */
+struct Air
+{
+	double loss; // Probability that a packet or ACK is lost, per receiver
+	unsigned long seed;
+	// Called for every packet on the air, returns the number of virtual nodes that ACK it
+	int (*virtual_node)(const Packet & p);
+};
+
+extern Air air;
+extern unsigned long now_us;
+extern unsigned long spi_byte_us; // Time per SPI byte, 4us at 2MHz, 0 to stop the clock while polling other nodes
+
+/* Reset the clock, the air and every radio */
+void reset(void);
+
+/* Run the simulation forward to now_us + us */
+void advance(unsigned long us);
+
+/* Radio driven by this CE or CSN pin, 0 if none */
+Radio * radio_by_pin(int pin);
+
+/* Radio with CSN low, 0 if none */
+Radio * selected_radio(void);
+
+/* Put a packet on the air from a virtual node at time at_us */
+void inject(unsigned long at_us, const unsigned char addr [], int addrWidth, const unsigned char data [], int width);
+
+/* Deterministic random number 0-1 for loss and jitter */
+double random01(void);
+
+}
+
+#endif
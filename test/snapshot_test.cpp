@@ -0,0 +1,198 @@
+/* snapshot_test.cpp - Configuration snapshot restore against the register model
+	Released to the public domain.
+
+ A node is configured as a receiver and snapshotted, then restored
+	reset    after a brownout, fromReset = 1
+	full     after a brownout, fromReset = 0
+	powered  over a chip that is still configured and powered, fromReset = 0
+ A packet is put on the air every 100us from the start of the restore, so the
+ recovery time to the first packet received is measured.
+*/
+
+#include "nRF24L01p.h"
+#include "nRF24L01_define_map.h"
+#include "fake_radio.h"
+#include "expect.h"
+
+fake::Radio chip(9, 10);
+NRF24L01p radio(9, 10);
+
+const int payloadWidth = 3;
+unsigned char nodeAddr [] = {0x5A,0x5A,0x5A};
+
+// Registers kept in a snapshot, besides the addresses and CONFIG
+const unsigned char snapshotRegs [] = {EN_AA, EN_RXADDR, SETUP_AW, SETUP_RETR, RF_CH, RF_SETUP,
+	RX_ADDR_P2, RX_ADDR_P3, RX_ADDR_P4, RX_ADDR_P5, RX_PW_P0, RX_PW_P1, RX_PW_P2, RX_PW_P3, RX_PW_P4, RX_PW_P5,
+	DYNPD, FEATURE};
+const unsigned char addressRegs [] = {RX_ADDR_P0, RX_ADDR_P1, TX_ADDR};
+#define REG_NUM ((int)sizeof(snapshotRegs))
+#define ADDR_NUM ((int)sizeof(addressRegs))
+
+struct Case
+{
+	unsigned long spi_bytes;
+	unsigned long restore_us;
+	unsigned long first_packet_us;
+	bool written [0x20]; // W_REGISTER seen for this register
+	int config_writes;
+	int last_written; // Register of the last W_REGISTER
+	unsigned char before [0x20]; // Register file before the restore
+};
+
+static void configure(void)
+{
+	fake::reset();
+	radio.begin();
+	unsigned char pipesOn [] = {0x03}; // Same as the reset value
+	radio.setup_data_pipes(pipesOn, payloadWidth);
+	radio.set_data_rate(250);
+	unsigned char awArg [] = {0x01};
+	radio.writeRegister(SETUP_AW, awArg, 1);
+	unsigned char chArg [] = {0x4C};
+	radio.writeRegister(RF_CH, chArg, 1);
+	unsigned char aaArg [] = {0x01};
+	radio.writeRegister(EN_AA, aaArg, 1);
+	radio.writeRegister(RX_ADDR_P0, nodeAddr, 3);
+	radio.enable_dynamic_ack(1);
+	radio.rMode();
+	fake::advance(2000);
+}
+
+static Case restore(unsigned char blob [], bool brownout, bool fromReset)
+{
+	Case res;
+	memset(&res, 0, sizeof(res));
+	// Let the packets of the last case finish
+	fake::advance(5000);
+	if (brownout)
+		chip.power_on_reset();
+	int ind = 0;
+	while (ind < 0x20)
+	{
+		res.before[ind] = chip.reg(ind);
+		ind = ind+1;
+	}
+	chip.logging = 1;
+	chip.log.clear();
+
+	unsigned long tmp_start = fake::now_us;
+	unsigned long tmp_bytes = chip.spi_bytes;
+	unsigned char tmp_packet [] = {0x11, 0x22, 0x33};
+	for (int k=1; k<=40; k++)
+		fake::inject(tmp_start + 100*k, nodeAddr, 3, tmp_packet, payloadWidth);
+
+	EXPECT(radio.snapshotRestore(blob, fromReset));
+	res.restore_us = fake::now_us - tmp_start;
+	res.spi_bytes = chip.spi_bytes - tmp_bytes;
+	while (chip.rx_fifo.empty() && fake::now_us - tmp_start < 5000)
+		fake::advance(10);
+	res.first_packet_us = fake::now_us - tmp_start;
+
+	res.last_written = -1;
+	for (size_t t=0; t<chip.log.size(); t++)
+	{
+		unsigned char tmp_cmd = chip.log[t].bytes[0];
+		if ((tmp_cmd & ~REGISTER_MASK) != W_REGISTER)
+			continue;
+		int tmp_reg = tmp_cmd & REGISTER_MASK;
+		res.written[tmp_reg] = 1;
+		res.last_written = tmp_reg;
+		if (tmp_reg == CONFIG)
+			res.config_writes = res.config_writes+1;
+	}
+	chip.logging = 0;
+	return res;
+}
+
+// The chip holds the configuration the snapshot was taken from
+static void expect_configured(const unsigned char regs [], const unsigned char addrs [][5])
+{
+	for (int i=0; i<REG_NUM; i++)
+		EXPECT(chip.reg(snapshotRegs[i]) == regs[i]);
+	for (int i=0; i<ADDR_NUM; i++)
+		EXPECT(memcmp(chip.address(addressRegs[i]), addrs[i], 3) == 0);
+	EXPECT(chip.reg(CONFIG) == regs[REG_NUM]);
+	EXPECT(radio.snapshotVerify());
+}
+
+static void print_case(const char * name, const Case & c)
+{
+	printf("  %-8s %4lu SPI bytes  restore %5lu us  first packet %5lu us\n", name, c.spi_bytes, c.restore_us, c.first_packet_us);
+}
+
+int main(void)
+{
+	configure();
+	unsigned char configured [REG_NUM+1];
+	unsigned char configuredAddrs [ADDR_NUM][5];
+	for (int i=0; i<REG_NUM; i++)
+		configured[i] = chip.reg(snapshotRegs[i]);
+	for (int i=0; i<ADDR_NUM; i++)
+		memcpy(configuredAddrs[i], chip.address(addressRegs[i]), 5);
+	configured[REG_NUM] = chip.reg(CONFIG);
+
+	unsigned char blob [NRF24L01P_SNAPSHOT_SIZE];
+	radio.snapshotSave(blob);
+
+	// Brownout: every register is back at its reset value and CONFIG no longer matches
+	chip.power_on_reset();
+	EXPECT(!radio.snapshotVerify());
+
+	Case fromReset = restore(blob, 1, 1);
+	expect_configured(configured, configuredAddrs);
+	// Only registers that differ from their reset value are written
+	for (int i=0; i<REG_NUM; i++)
+	{
+		unsigned char r = snapshotRegs[i];
+		EXPECT(fromReset.written[r] == (configured[i] != fromReset.before[r]));
+	}
+	EXPECT(!fromReset.written[EN_RXADDR]);
+	EXPECT(fromReset.written[RF_CH]);
+	EXPECT(fromReset.written[RX_ADDR_P0]);
+	EXPECT(!fromReset.written[RX_ADDR_P1]);
+	EXPECT(!fromReset.written[TX_ADDR]);
+
+	Case full = restore(blob, 1, 0);
+	expect_configured(configured, configuredAddrs);
+	for (int i=0; i<REG_NUM; i++)
+		EXPECT(full.written[snapshotRegs[i]]);
+	for (int i=0; i<ADDR_NUM; i++)
+		EXPECT(full.written[addressRegs[i]]);
+
+	Case powered = restore(blob, 0, 0);
+	expect_configured(configured, configuredAddrs);
+
+	printf("snapshot_test: restore into the register model\n");
+	print_case("reset", fromReset);
+	print_case("full", full);
+	print_case("powered", powered);
+
+	// CONFIG is written once and last, after every other register and the STATUS clear
+	EXPECT(fromReset.config_writes == 1 && fromReset.last_written == CONFIG);
+	EXPECT(full.config_writes == 1 && full.last_written == CONFIG);
+	EXPECT(powered.config_writes == 1 && powered.last_written == CONFIG);
+
+	// The 1.5ms wait only happens when the restore powers the chip up
+	EXPECT(fromReset.restore_us >= 1500);
+	EXPECT(full.restore_us >= 1500);
+	EXPECT(powered.restore_us < 1000);
+	EXPECT(chip.pwrup_violations == 0);
+
+	// Skipping reset values saves SPI time
+	EXPECT(fromReset.spi_bytes < full.spi_bytes);
+	EXPECT(fromReset.restore_us < full.restore_us);
+
+	// The node is back on the air within one packet interval of the restore returning
+	EXPECT(fromReset.first_packet_us <= fromReset.restore_us + 100 + 10);
+	EXPECT(full.first_packet_us <= full.restore_us + 100 + 10);
+	EXPECT(powered.first_packet_us <= powered.restore_us + 100 + 10);
+
+	// A corrupted blob is refused and nothing is written
+	blob[5] = blob[5]+1;
+	chip.logging = 1;
+	chip.log.clear();
+	EXPECT(!radio.snapshotRestore(blob, 1));
+	EXPECT(chip.log.empty());
+
+	return EXPECT_DONE("snapshot_test");
+}
@@ -0,0 +1,190 @@
+/* stream_test.cpp - NOACK broadcast streaming against acked streaming
+	Released to the public domain.
+
+ One transmitter, three receivers on a shared broadcast address, 10% loss
+ per packet and per receiver. Reports packets/s and loss for
+	acked    txData + clear_interrupts per packet, only receiver 0 ACKs
+	noack x1 streamSend, each packet sent once
+	noack x3 streamSend, each packet sent three times
+*/
+
+#include "nRF24L01p.h"
+#include "nRF24L01_define_map.h"
+#include "fake_radio.h"
+#include "expect.h"
+
+#define RX_NUM 3
+#define PACKETS 2000
+
+fake::Radio txChip(9, 10);
+fake::Radio rxChip0(7, 8);
+fake::Radio rxChip1(5, 6);
+fake::Radio rxChip2(3, 4);
+fake::Radio * rxChips [RX_NUM] = {&rxChip0, &rxChip1, &rxChip2};
+
+NRF24L01p txRadio(9, 10);
+NRF24L01p rxRadio0(7, 8);
+NRF24L01p rxRadio1(5, 6);
+NRF24L01p rxRadio2(3, 4);
+NRF24L01p * rxRadios [RX_NUM] = {&rxRadio0, &rxRadio1, &rxRadio2};
+
+const int dataWidth = 2;
+unsigned char broadcastAddr [] = {0xC2,0xC2,0xC2};
+
+struct Result
+{
+	double pps;
+	double loss [RX_NUM];
+};
+
+// 3-byte addresses, streamBegin sets the transmitter to the same width
+unsigned char awArg [] = {0x01};
+
+static void setup_receivers(bool oneAcker)
+{
+	for (int i=0; i<RX_NUM; i++)
+	{
+		NRF24L01p * r = rxRadios[i];
+		r->begin();
+		unsigned char pipesOn [] = {0x01};
+		r->setup_data_pipes(pipesOn, dataWidth+1);
+		r->writeRegister(RX_ADDR_P0, broadcastAddr, 3);
+		r->writeRegister(SETUP_AW, awArg, 1);
+		// Only one receiver may ACK a broadcast, the other ACKs would collide
+		unsigned char enAA [] = {(unsigned char)((oneAcker && i == 0) ? 0x01 : 0x00)};
+		r->writeRegister(EN_AA, enAA, 1);
+		r->rMode();
+		r->resetStreamStats();
+	}
+	fake::advance(2000);
+}
+
+// Receivers run on their own MCUs, so polling them does not cost the transmitter time
+static void poll_receivers(void)
+{
+	unsigned long tmp_spi = fake::spi_byte_us;
+	fake::spi_byte_us = 0;
+	for (int i=0; i<RX_NUM; i++)
+	{
+		while (!(*rxRadios[i]->readRegister(FIFO_STATUS, 1) & (1<<RX_EMPTY)))
+			rxRadios[i]->streamReceive(dataWidth);
+	}
+	fake::spi_byte_us = tmp_spi;
+}
+
+static Result finish(unsigned long startTime)
+{
+	Result res;
+	res.pps = PACKETS * 1e6 / (fake::now_us - startTime);
+	for (int i=0; i<RX_NUM; i++)
+	{
+		unsigned long rx = rxRadios[i]->getStreamRxCount();
+		unsigned long lost = rxRadios[i]->getStreamLostCount();
+		// Packets lost after the last one received are not seen as a gap
+		lost = lost + (PACKETS - rx - lost);
+		res.loss[i] = (double)lost / PACKETS;
+		EXPECT(rx <= PACKETS);
+	}
+	return res;
+}
+
+static Result run_acked(void)
+{
+	fake::reset();
+	fake::air.loss = 0.10;
+	setup_receivers(1);
+
+	txRadio.begin();
+	txRadio.writeRegister(TX_ADDR, broadcastAddr, 3);
+	txRadio.writeRegister(RX_ADDR_P0, broadcastAddr, 3);
+	txRadio.writeRegister(SETUP_AW, awArg, 1);
+	txRadio.txMode();
+	fake::advance(1500);
+
+	unsigned long startTime = fake::now_us;
+	for (int n=0; n<PACKETS; n++)
+	{
+		unsigned char tmpPacket [] = {(unsigned char)n, 0x55, 0xAA};
+		txRadio.txData(tmpPacket, dataWidth+1);
+		// Wait for TX_DS or MAX_RT, then clear them as the examples do
+		while (!(*txRadio.readRegister(STATUS, 1) & ((1<<TX_DS) | (1<<MAX_RT))))
+		{}
+		txRadio.clear_interrupts();
+		poll_receivers();
+	}
+	return finish(startTime);
+}
+
+static Result run_noack(int copies)
+{
+	fake::reset();
+	fake::air.loss = 0.10;
+	setup_receivers(0);
+
+	txRadio.begin();
+	txRadio.streamBegin(broadcastAddr, 3, copies);
+
+	unsigned long startTime = fake::now_us;
+	for (int n=0; n<PACKETS; n++)
+	{
+		unsigned char tmpData [] = {0x55, 0xAA};
+		EXPECT(txRadio.streamSend(tmpData, dataWidth));
+		poll_receivers();
+	}
+	txRadio.streamEnd();
+	poll_receivers();
+	Result res = finish(startTime);
+
+	// TX mode limit and power-up delay from the spec
+	EXPECT(txChip.max_tx_run_us <= 4000);
+	EXPECT(txChip.pwrup_violations == 0);
+	EXPECT(txChip.tx_overflows == 0);
+	EXPECT(txChip.transmissions == (unsigned long)PACKETS*copies);
+	return res;
+}
+
+static void print_result(const char * name, const Result & res)
+{
+	printf("  %-9s %8.0f packets/s  loss", name, res.pps);
+	for (int i=0; i<RX_NUM; i++)
+		printf(" %5.1f%%", 100*res.loss[i]);
+	printf("\n");
+}
+
+int main(void)
+{
+	Result acked = run_acked();
+	Result noack1 = run_noack(1);
+	Result noack3 = run_noack(3);
+
+	printf("stream_test: %d packets, %d receivers, 10%% loss\n", PACKETS, RX_NUM);
+	print_result("acked", acked);
+	print_result("noack x1", noack1);
+	print_result("noack x3", noack3);
+
+	// Fire-and-forget is several times faster than waiting for every ACK
+	EXPECT(noack1.pps > 4*acked.pps);
+	// Retransmits only help the receiver that ACKs
+	EXPECT(acked.loss[0] < 0.01);
+	// Without redundancy each receiver sees the air loss, three copies cut it to about 0.1%
+	for (int i=0; i<RX_NUM; i++)
+	{
+		EXPECT(noack1.loss[i] > 0.06 && noack1.loss[i] < 0.14);
+		EXPECT(noack3.loss[i] < 0.01);
+	}
+
+	// Payload limits: 4 data bytes plus the sequence number
+	fake::reset();
+	txRadio.begin();
+	txRadio.streamBegin(broadcastAddr, 3, 1);
+	// The address width goes to SETUP_AW, not only to the TX_ADDR write
+	EXPECT(txChip.reg(SETUP_AW) == 0x01);
+	unsigned char tmpData [] = {1, 2, 3, 4, 5};
+	EXPECT(!txRadio.streamSend(tmpData, 5));
+	EXPECT(!txRadio.streamSend(tmpData, 0));
+	EXPECT(txRadio.streamSend(tmpData, 4));
+	txRadio.streamEnd();
+	EXPECT(txChip.transmissions == 1);
+
+	return EXPECT_DONE("stream_test");
+}
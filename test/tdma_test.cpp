@@ -0,0 +1,198 @@
+/* tdma_test.cpp - TDMA polling scheduler against 60 simulated slaves
+	Released to the public domain.
+
+ Slaves are virtual nodes on fake::air: they ACK the query and answer after
+ their own response time with +-50us of jitter.
+	slaves 0-49    six response time classes, 150us to 6ms
+	slave  50      1.5ms, but every 5th answer comes 30ms late
+	slaves 55-59   absent, the query ends in MAX_RT
+ Checks that the histogram lands in the right bucket, slot lengths adapt to
+ twice the response time, late answers are not credited to the next slave
+ and run never blocks or turns the radio around under a packet. A brownout of
+ the master's radio is recovered from without help.
+*/
+
+#include "nRF24L01p.h"
+#include "nRF24L01p_tdma.h"
+#include "nRF24L01_define_map.h"
+#include "fake_radio.h"
+#include "expect.h"
+
+#define SLAVES 60
+#define LATE_SLAVE 50
+#define FIRST_ABSENT 55
+#define RUN_US 3000000UL
+#define LOOP_US 20 // Time the sketch spends in loop between calls to run
+#define MIN_SLOT_US 1000
+#define MAX_SLOT_US 20000
+
+fake::Radio masterChip(9, 10);
+NRF24L01p masterRadio(9, 10);
+TDMA_slave slaveTable [SLAVES];
+NRF24L01pTDMA scheduler(masterRadio, slaveTable, SLAVES);
+
+const int payloadWidth = 3;
+unsigned char masterAddr [] = {0xE7,0xE7,0xE7};
+
+// Latency seen by the master, from the ACK of the query to the answer
+const unsigned long latencyClass [] = {150, 400, 750, 1500, 3000, 6000};
+// Time from the slave receiving the query to the master receiving the ACK
+#define ACK_US 160
+
+unsigned long queries [SLAVES];
+unsigned long wrongSlave = 0; // Responses handed to the handler for another slave
+
+static unsigned long slave_latency(int slave)
+{
+	if (slave == LATE_SLAVE)
+		return 1500;
+	return latencyClass[slave % 6];
+}
+
+static int slave_node(const fake::Packet & p)
+{
+	if (p.addr_width != 3 || p.addr[1] != 0xB5 || p.addr[2] != 0xB5)
+		return 0;
+	int slave = p.addr[0];
+	if (slave >= FIRST_ABSENT)
+		return 0;
+
+	queries[slave] = queries[slave]+1;
+	unsigned long tmp_delay = ACK_US + slave_latency(slave) - 50 + (unsigned long)(100*fake::random01());
+	if (slave == LATE_SLAVE && queries[slave] % 5 == 0)
+		tmp_delay = 30000;
+	unsigned char tmp_response [] = {(unsigned char)slave, 0x02, 0x00};
+	fake::inject(fake::now_us + tmp_delay, masterAddr, 3, tmp_response, payloadWidth);
+	return 1;
+}
+
+static void slave_response(int slave, unsigned char * data)
+{
+	if (data[0] != slave)
+		wrongSlave = wrongSlave+1;
+}
+
+int main(void)
+{
+	fake::reset();
+	fake::air.virtual_node = slave_node;
+
+	masterRadio.begin();
+	EXPECT(scheduler.begin(masterAddr, 3, payloadWidth, MIN_SLOT_US, MAX_SLOT_US));
+	for (int i=0; i<SLAVES; i++)
+	{
+		unsigned char slaveAddr [] = {(unsigned char)i, 0xB5, 0xB5};
+		EXPECT(scheduler.addSlave(slaveAddr, (unsigned char)i) == i);
+	}
+	unsigned char tmpQuery [] = {0x01, 0x01, 0x00};
+	scheduler.setQuery(tmpQuery);
+	scheduler.setResponseHandler(slave_response);
+
+	// Let the slots adapt, then measure
+	unsigned long tmp_end = fake::now_us + RUN_US/3;
+	while (fake::now_us < tmp_end)
+	{
+		scheduler.run(micros());
+		fake::advance(LOOP_US);
+	}
+	scheduler.resetStats();
+
+	unsigned long maxRunUs = 0;
+	tmp_end = fake::now_us + RUN_US;
+	while (fake::now_us < tmp_end)
+	{
+		unsigned long tmp_start = fake::now_us;
+		scheduler.run(micros());
+		if (fake::now_us - tmp_start > maxRunUs)
+			maxRunUs = fake::now_us - tmp_start;
+		fake::advance(LOOP_US);
+	}
+
+	unsigned int cycles = scheduler.getResponseCount(0) + scheduler.getMissCount(0);
+	printf("tdma_test: %d slaves, %u cycles in %lu ms, longest run %lu us, %lu strays\n",
+		SLAVES, cycles, RUN_US/1000, maxRunUs, scheduler.getStrayCount());
+	printf("  slave  latency      p50      p90      p99     slot  missed\n");
+	for (int i=0; i<SLAVES; i++)
+	{
+		if (i < 6 || i == LATE_SLAVE || i == FIRST_ABSENT)
+		{
+			printf("  %5d %8lu %8lu %8lu %8lu %8lu %7u\n", i,
+				i < FIRST_ABSENT ? slave_latency(i) : 0,
+				scheduler.getLatencyPercentile(i, 50), scheduler.getLatencyPercentile(i, 90),
+				scheduler.getLatencyPercentile(i, 99), scheduler.getSlotLength(i), scheduler.getMissCount(i));
+		}
+	}
+
+	EXPECT(cycles > 10);
+	for (int i=0; i<FIRST_ABSENT; i++)
+	{
+		if (i == LATE_SLAVE)
+			continue;
+		unsigned long tmp_latency = slave_latency(i);
+		// Every slave answers in every cycle
+		EXPECT(scheduler.getMissCount(i) == 0);
+		EXPECT(scheduler.getResponseCount(i) + 1 >= cycles);
+
+		// p50 and p99 are the upper edge of the bucket that holds the response time
+		unsigned long tmp_edge = TDMA_HIST_BASE_US;
+		while (tmp_edge <= tmp_latency)
+			tmp_edge = 2*tmp_edge;
+		EXPECT(scheduler.getLatencyPercentile(i, 50) == tmp_edge);
+		EXPECT(scheduler.getLatencyPercentile(i, 99) == tmp_edge);
+
+		// Slots shrink to twice the response time, never below the minimum
+		long tmp_slot = 2*tmp_latency < MIN_SLOT_US ? MIN_SLOT_US : 2*tmp_latency;
+		long tmp_error = (long)scheduler.getSlotLength(i) - tmp_slot;
+		EXPECT(tmp_error < 200 && tmp_error > -200);
+	}
+
+	// Late answers are misses for their own slave and strays in later slots
+	EXPECT(scheduler.getMissCount(LATE_SLAVE) + 1 >= cycles/5);
+	EXPECT(scheduler.getMissCount(LATE_SLAVE) <= cycles/5 + 1);
+	EXPECT(scheduler.getStrayCount() > 0);
+	EXPECT(wrongSlave == 0);
+
+	// Absent slaves miss on MAX_RT and keep the longest slot
+	for (int i=FIRST_ABSENT; i<SLAVES; i++)
+	{
+		EXPECT(scheduler.getResponseCount(i) == 0);
+		EXPECT(scheduler.getMissCount(i) + 1 >= cycles);
+		EXPECT(scheduler.getSlotLength(i) == MAX_SLOT_US);
+	}
+
+	// run is a few SPI transactions, PRIM_RX never changes under the query or its retransmits
+	EXPECT(maxRunUs < 200);
+	EXPECT(masterChip.tx_aborts == 0);
+	EXPECT(masterChip.pwrup_violations == 0);
+
+	// Brownout right after a query goes out: the query phase times out, the
+	// scheduler sees CONFIG has reset, writes its registers again and powers up
+	scheduler.run(micros());
+	masterChip.power_on_reset();
+	scheduler.resetStats();
+	tmp_end = fake::now_us + RUN_US/3;
+	while (fake::now_us < tmp_end)
+	{
+		scheduler.run(micros());
+		fake::advance(LOOP_US);
+	}
+	unsigned int brownoutMisses = 0;
+	for (int i=0; i<FIRST_ABSENT; i++)
+	{
+		if (i == LATE_SLAVE)
+			continue;
+		EXPECT(scheduler.getResponseCount(i) > 0);
+		brownoutMisses = brownoutMisses + scheduler.getMissCount(i);
+	}
+	printf("  brownout: %u missed slots, polling resumed\n", brownoutMisses);
+	EXPECT(brownoutMisses <= 2);
+	EXPECT(masterChip.reg(SETUP_AW) == 0x01);
+	EXPECT(masterChip.pwrup_violations == 0);
+
+	// Payload widths above the 5-byte query buffer are refused
+	NRF24L01pTDMA wideScheduler(masterRadio, slaveTable, SLAVES);
+	EXPECT(!wideScheduler.begin(masterAddr, 3, 6, MIN_SLOT_US, MAX_SLOT_US));
+	EXPECT(!wideScheduler.begin(masterAddr, 3, 0, MIN_SLOT_US, MAX_SLOT_US));
+
+	return EXPECT_DONE("tdma_test");
+}
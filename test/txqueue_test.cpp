@@ -0,0 +1,176 @@
+/* txqueue_test.cpp - Worst-case urgent latency of the priority TX queues
+	Released to the public domain.
+
+ The receiver is a virtual node that ACKs urgent frames at once and bulk
+ frames only on their last retransmit, so every bulk frame takes as long as
+ it can without failing. That is the worst case for an urgent frame queued
+ behind it, and the bulk frames left in the TX FIFO must be preempted.
+
+ Bound checked under saturating bulk load
+	one bulk frame with all retries (measured alone)
+	+ the urgent frame itself (measured alone)
+	+ the time between service() calls and the SPI work in one service() call
+ A brownout with a frame on the air must not stall the queue.
+*/
+
+#include "nRF24L01p.h"
+#include "nRF24L01p_txqueue.h"
+#include "nRF24L01_define_map.h"
+#include "fake_radio.h"
+#include "expect.h"
+
+#define LOOP_US 20 // Time the sketch spends in loop between calls to service
+#define SERVICE_US 150 // Flush, requeue, three payload uploads and the CE pulse
+#define RUN_US 2000000UL
+
+#define RETRIES 5 // ARC, retransmits per frame
+#define URGENT_TAG 0xA0
+#define BULK_TAG 0xB0
+
+fake::Radio txChip(9, 10);
+NRF24L01p txRadio(9, 10);
+
+TXQ_frame urgentBuf [4];
+TXQ_frame bulkBuf [16];
+NRF24L01pTxQueue txQueue(txRadio, urgentBuf, 4, bulkBuf, 16);
+
+const int payloadWidth = 3;
+unsigned char txAddr [] = {0xE7,0xE7,0xE7};
+
+static int receiver_node(const fake::Packet & p)
+{
+	static unsigned char lastSeq = 0;
+	static int copies = 0;
+	if (p.data[0] == URGENT_TAG)
+		return 1;
+	// Count transmissions of the same bulk frame, ACK the last one
+	if (copies == 0 || p.data[1] != lastSeq)
+		copies = 0;
+	lastSeq = p.data[1];
+	copies = copies+1;
+	if (copies < RETRIES+1)
+		return 0;
+	copies = 0;
+	return 1;
+}
+
+static void setup_radio(void)
+{
+	fake::reset();
+	fake::air.virtual_node = receiver_node;
+	txRadio.begin();
+	unsigned char pipesOn [] = {0x01};
+	txRadio.setup_data_pipes(pipesOn, payloadWidth);
+	txRadio.writeRegister(RX_ADDR_P0, txAddr, 3);
+	txRadio.writeRegister(TX_ADDR, txAddr, 3);
+	// ARD 500us
+	unsigned char retrArg [] = {(1<<ARD) | RETRIES};
+	txRadio.writeRegister(SETUP_RETR, retrArg, 1);
+	// begin waits out the power-up delay itself
+	txQueue.begin();
+	txQueue.resetStats();
+}
+
+// Time from enqueue to the queue going idle for a single frame
+static unsigned long alone_us(int priority, unsigned char tag)
+{
+	setup_radio();
+	unsigned char tmpData [] = {tag, 0x00, 0x00};
+	unsigned long tmp_start = fake::now_us;
+	EXPECT(txQueue.enqueue(priority, tmpData, payloadWidth, micros()));
+	while (!txQueue.idle())
+	{
+		txQueue.service(micros());
+		fake::advance(LOOP_US);
+	}
+	return fake::now_us - tmp_start;
+}
+
+int main(void)
+{
+	unsigned long bulkRetryUs = alone_us(TXQ_BULK, BULK_TAG);
+	EXPECT(txQueue.getSentCount(TXQ_BULK) == 1);
+	EXPECT(txChip.transmissions == RETRIES+1);
+	unsigned long urgentUs = alone_us(TXQ_URGENT, URGENT_TAG);
+	EXPECT(txQueue.getSentCount(TXQ_URGENT) == 1);
+	unsigned long bound = bulkRetryUs + urgentUs + LOOP_US + SERVICE_US;
+
+	// Keep the bulk queue full and queue an urgent frame at a random point every 5-10ms
+	setup_radio();
+	unsigned long urgentQueued = 0;
+	unsigned long nextUrgent = fake::now_us + 5000;
+	unsigned long tmp_end = fake::now_us + RUN_US;
+	unsigned char bulkData [] = {BULK_TAG, 0x00, 0x00};
+	unsigned char urgentData [] = {URGENT_TAG, 0x00, 0x00};
+	while (fake::now_us < tmp_end)
+	{
+		while (txQueue.enqueue(TXQ_BULK, bulkData, payloadWidth, micros()))
+			bulkData[1] = bulkData[1]+1;
+		if (fake::now_us >= nextUrgent)
+		{
+			EXPECT(txQueue.enqueue(TXQ_URGENT, urgentData, payloadWidth, micros()));
+			urgentQueued = urgentQueued+1;
+			nextUrgent = fake::now_us + 5000 + (unsigned long)(5000*fake::random01());
+		}
+		txQueue.service(micros());
+		fake::advance(LOOP_US);
+	}
+	while (!txQueue.idle() && txQueue.getSentCount(TXQ_URGENT) < urgentQueued)
+	{
+		txQueue.service(micros());
+		fake::advance(LOOP_US);
+	}
+
+	unsigned long worst = txQueue.getMaxLatency(TXQ_URGENT);
+	printf("txqueue_test: %lu urgent frames under saturating bulk load\n", urgentQueued);
+	printf("  bulk frame with all retries %6lu us\n", bulkRetryUs);
+	printf("  urgent frame alone          %6lu us\n", urgentUs);
+	printf("  worst urgent latency        %6lu us (bound %lu us)\n", worst, bound);
+	printf("  preemptions %u, bulk frames sent %lu\n", txQueue.getPreemptCount(), txQueue.getSentCount(TXQ_BULK));
+
+	// Every urgent frame gets through within one bulk frame plus itself
+	EXPECT(txQueue.getSentCount(TXQ_URGENT) == urgentQueued);
+	EXPECT(txQueue.getFailedCount(TXQ_URGENT) == 0);
+	EXPECT(worst <= bound);
+	// The load really was saturating: urgent frames waited behind bulk frames on the air
+	EXPECT(worst > urgentUs + bulkRetryUs/2);
+	EXPECT(txQueue.getPreemptCount() > 0);
+	EXPECT(txQueue.getFullCount(TXQ_URGENT) == 0);
+	EXPECT(txQueue.getFailedCount(TXQ_BULK) == 0);
+
+	// Priorities outside the classes are refused without touching the queues
+	EXPECT(!txQueue.enqueue(-1, urgentData, payloadWidth, micros()));
+	EXPECT(!txQueue.enqueue(TXQ_CLASSES, urgentData, payloadWidth, micros()));
+	EXPECT(txQueue.getFullCount(TXQ_URGENT) == 0);
+	EXPECT(txQueue.getFullCount(TXQ_BULK) > 0);
+	// So are payload widths outside 1-5
+	unsigned char tmpLong [] = {URGENT_TAG, 1, 2, 3, 4, 5};
+	EXPECT(!txQueue.enqueue(TXQ_URGENT, tmpLong, 6, micros()));
+	EXPECT(!txQueue.enqueue(TXQ_URGENT, tmpLong, 0, micros()));
+	EXPECT(txChip.pwrup_violations == 0);
+
+	// Brownout right after the CE pulse: neither TX_DS nor MAX_RT comes, the frame
+	// goes back to its queue, the chip is powered up again and the frame is resent
+	// ahead of the bulk frames still queued from the load above
+	setup_radio();
+	EXPECT(txQueue.enqueue(TXQ_URGENT, urgentData, payloadWidth, micros()));
+	txQueue.service(micros());
+	txChip.power_on_reset();
+	unsigned long tmp_start = fake::now_us;
+	while (txQueue.getSentCount(TXQ_URGENT) == 0 && fake::now_us - tmp_start < 100000)
+	{
+		txQueue.service(micros());
+		fake::advance(LOOP_US);
+	}
+	unsigned long recoverUs = fake::now_us - tmp_start;
+	printf("  brownout with a frame on the air, resent after %lu us\n", recoverUs);
+	EXPECT(txQueue.getTimeoutCount() == 1);
+	EXPECT(txQueue.getSentCount(TXQ_URGENT) == 1);
+	EXPECT(txQueue.getFailedCount(TXQ_URGENT) == 0);
+	// Deadline for ARC 5 and ARD 500us, then the power-up delay
+	EXPECT(recoverUs >= (RETRIES+1)*(500 + TXQ_ATTEMPT_US) + NRF24L01P_POWER_UP_US);
+	EXPECT(recoverUs < (RETRIES+1)*(500 + TXQ_ATTEMPT_US) + NRF24L01P_POWER_UP_US + 1000);
+	EXPECT(txChip.pwrup_violations == 0);
+
+	return EXPECT_DONE("txqueue_test");
+}